@@ -1,7 +1,9 @@
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+#define _GNU_SOURCE
+#include "sweep.h"
+
+//bump whenever simulate_and_write output changes so old cache entries stop matching
+#define CACHE_VERSION 1
 
 //each row from input is saved as a row
 typedef struct {
@@ -12,6 +14,8 @@ typedef struct {
     int index;      
 } Row;
 
+_Static_assert(offsetof(Row,index)==offsetof(JobHead,index), "Row has to start with the JobHead fields");
+
 //dynamic array to save the rows 
 typedef struct {
     Row *data;
@@ -62,7 +66,41 @@ static int cmp_row(const void *a, const void *b){
     return ra->index<rb->index? -1 : (ra->index>rb->index);
 }
 
-static void simulate_and_write(const Row *arr, size_t n, int latency, FILE *f_details, FILE *f_summary){
+static const char *const detail_names[]={ "Scheduler_Latency", "Pid", "Arrival Time", "Start Time", "Finish Time",
+    "Turnaround Time", "Waiting Time", "Response Time" };
+static const char *const summary_names[]={ "Scheduler_Latency", "Throughput", "Avg_Waiting_Time", "Avg_Turnaround_Time",
+    "Avg_Response_Time" };
+
+//open the pair of outputs in the selected format, returns 0 and closes whatever did open on failure
+static int open_outputs(const char *details, const char *summary, int l_lo, int l_hi,
+                        FILE **f_details, FILE **f_summary){
+
+    if(col_out){
+        //fcfs has no second parameter, so the fixed slot is -1
+        *f_details=col_open(details, "Scheduler_Latency", l_lo, l_hi, -1, 8, "iiiiiiii", detail_names);
+        *f_summary=col_open(summary, "Scheduler_Latency", l_lo, l_hi, -1, 5, "ifddd", summary_names);
+    } 
+    else{
+        *f_details=fopen(details, "w");
+        *f_summary=fopen(summary, "w");
+    }
+
+    if(!*f_details || !*f_summary){
+        if(*f_details) fclose(*f_details);
+        if(*f_summary) fclose(*f_summary);
+        return 0;
+    }
+    return 1;
+}
+
+//run fcfs at one latency, writing detail rows when f_details is set, and leave
+//throughput, average waiting, turnaround and response time in vals
+static void fcfs_run(const Row *arr, size_t n, int latency, FILE *f_details, double vals[4]){
+
+    memset(vals,0,4*sizeof(double));
+    if(n==0){
+        return;
+    }
 
     long long current_time=0;
     long long total_wait=0, total_turn=0, total_resp=0;
@@ -88,8 +126,14 @@ static void simulate_and_write(const Row *arr, size_t n, int latency, FILE *f_de
         total_wait += waiting;
         total_resp += response;
 
-        //write simulated values
-        fprintf(f_details,"%d,%d,%d,%lld,%lld,%lld,%lld,%lld\n", latency, p->pid, p->arrival, start, finish, turnaround, waiting, response);
+        //write simulated values, ensemble runs keep no per job rows
+        if(f_details && col_out){
+            int64_t rec[8]={ latency, p->pid, p->arrival, start, finish, turnaround, waiting, response };
+            fwrite(rec,sizeof(rec),1,f_details);
+        }
+        else if(f_details){
+            fprintf(f_details,"%d,%d,%d,%lld,%lld,%lld,%lld,%lld\n", latency, p->pid, p->arrival, start, finish, turnaround, waiting, response);
+        }
 
         current_time=finish;
         last_finish=finish;
@@ -103,23 +147,74 @@ static void simulate_and_write(const Row *arr, size_t n, int latency, FILE *f_de
     double elapsed = last_finish - first_arrival;
     double throughput = dn/elapsed;
 
-    fprintf(f_summary,"%d,%.6f,%.2f,%.2f,%.2f\n", latency, throughput, avg_wait, avg_turn, avg_resp);
+    vals[0]=throughput;
+    vals[1]=avg_wait;
+    vals[2]=avg_turn;
+    vals[3]=avg_resp;
+}
+
+static void simulate_and_write(const Row *arr, size_t n, int latency, FILE *f_details, FILE *f_summary){
+
+    //no jobs, no summary row, same as the rr simulator
+    if(n==0){
+        return;
+    }
+
+    double vals[4];
+    fcfs_run(arr,n,latency,f_details,vals);
+
+    if(col_out){
+        int64_t l=latency;
+        fwrite(&l,sizeof(l),1,f_summary);
+        fwrite(vals,sizeof(vals),1,f_summary);
+        return;
+    }
+
+    fprintf(f_summary,"%d,%.6f,%.2f,%.2f,%.2f\n", latency, vals[0], vals[1], vals[2], vals[3]);
+}
+
+//one sweep point handed to the cache
+typedef struct{
+    const Row *arr;
+    size_t n;
+    int latency;
+} FcfsCell;
+
+static void fcfs_cell(void *ctx, FILE *f_details, FILE *f_summary){
+    const FcfsCell *fc=(const FcfsCell*)ctx;
+    simulate_and_write(fc->arr,fc->n,fc->latency,f_details,f_summary);
+}
+
+//run one latency point, serving it from the cache directory when this trace was already simulated with it
+static void run_cell(const Row *arr, size_t n, uint64_t hash, const char *cache_dir, int latency, FILE *f_details, FILE *f_summary){
+
+    if(!cache_dir || n==0){
+        simulate_and_write(arr,n,latency,f_details,f_summary);
+        return;
+    }
+
+    char path[4096];
+    snprintf(path,sizeof(path),"%s/fcfs-v%d-%016llx-l%d.%s",cache_dir,CACHE_VERSION,(unsigned long long)hash,latency,
+        col_out? "raw" : "csv");
+
+    FcfsCell fc={ arr, n, latency };
+    cache_cell(path,fcfs_cell,&fc,f_details,f_summary);
 }
 
-int main(void){
+//read the header and every row of a trace, returns 0 after reporting a missing header or a bad row
+static int load_trace(FILE *in, const char *name, Rows *rs){
 
-    //read header from stdin
+    //read header
     char buf[1024];
 
-    if(!fgets(buf,sizeof(buf),stdin)){
-        fprintf(stderr,"no input (expected header)\n");
-        return 1;
+    if(!fgets(buf,sizeof(buf),in)){
+        fprintf(stderr,"%s: no input (expected header)\n",name);
+        return 0;
     }
 
-    Rows rs; rows_init(&rs);
     size_t line_no=1;
 
-    while(fgets(buf,sizeof(buf),stdin)){
+    while(fgets(buf,sizeof(buf),in)){
 
         line_no++;
         // skip blank and comment lines
@@ -132,43 +227,268 @@ int main(void){
         if(blank) continue;
         if(buf[0]=='#') continue;
 
-        //read rows
-        Row r; r.index=(int)rs.size;
-        int ok = sscanf(buf," %d , %d , %d , %d ",&r.pid,&r.arrival,&r.first_resp,&r.burst);
+        //read rows, anything that would not fit is rejected instead of wrapping
+        Row r; r.index=(int)rs->size;
+        char *cur=buf;
+        if(!parse_field(&cur,&r.pid,0) || !parse_field(&cur,&r.arrival,0) || !parse_field(&cur,&r.first_resp,0)
+            || !parse_field(&cur,&r.burst,1) || r.burst<0){
+            fprintf(stderr,"%s:%zu: expected four comma separated integers that fit in 32 bits\n",name,line_no);
+            return 0;
+        }
+
+        rows_push(rs,r);
+    }
+    return 1;
+}
+
+static void write_headers(FILE *f_details, FILE *f_summary){
+
+    //column files carry their names in the file header
+    if(col_out){
+        return;
+    }
+    fprintf(f_details,"Scheduler_Latency,Pid,Arrival Time,Start Time,Finish Time,Turnaround Time,Waiting Time,Response Time\n");
+    
+    fprintf(f_summary,"Scheduler_Latency,Throughput,Avg_Waiting_Time,Avg_Turnaround_Time,Avg_Response_Time\n");
+}
+
+//batch and ensemble glue: the sweep every trace goes through
+typedef struct{
+    const char *cache_dir;
+    int l_lo;
+    int l_hi;
+} SweepCtx;
+
+static int load_rows(FILE *in, const char *path, void **jobs, size_t *n){
+
+    Rows rs; rows_init(&rs);
+    int ok=load_trace(in,path,&rs);
+    *jobs=rs.data;
+    *n=rs.size;
+    return ok;
+}
+
+static int batch_open(void *ctx, const char *details, const char *summary, FILE **f_details, FILE **f_summary){
+
+    const SweepCtx *sw=(const SweepCtx*)ctx;
+    if(!open_outputs(details,summary,sw->l_lo,sw->l_hi,f_details,f_summary)){
+        return 0;
+    }
+    write_headers(*f_details,*f_summary);
+    return 1;
+}
+
+static void batch_point(void *ctx, const void *jobs, size_t n, uint64_t hash, const void *extra, int cell,
+                        FILE *f_details, FILE *f_summary){
+
+    (void)extra;
+    const SweepCtx *sw=(const SweepCtx*)ctx;
+    run_cell((const Row*)jobs,n,hash,sw->cache_dir,sw->l_lo+cell,f_details,f_summary);
+}
+
+static int run_batch(char **paths, int ntraces, int l_lo, int l_hi, const char *cache_dir, int nworkers){
+
+    SweepCtx sw={ cache_dir, l_lo, l_hi };
+    BatchJob job={ "FCFS", sizeof(Row), cmp_row, load_rows, 0, NULL,
+        col_out? "fcfs_results_details.col" : "fcfs_results_details.csv", col_out? "fcfs_results.col" : "fcfs_results.csv",
+        batch_open, batch_point, &sw, l_hi-l_lo+1 };
+    return batch_run(&job,paths,ntraces,nworkers);
+}
+
+static void ensemble_point(void *ctx, void *worker, const void *jobs, size_t n, double *metrics){
+
+    (void)worker;
+    const SweepCtx *sw=(const SweepCtx*)ctx;
+    for(int L=sw->l_lo; L<=sw->l_hi; L++){
+        fcfs_run((const Row*)jobs,n,L,NULL,&metrics[(size_t)(L-sw->l_lo)*ENS_METRICS]);
+    }
+}
+
+static int run_ensemble(const Row *arr, size_t n, int k, int jitter, double scale, uint64_t seed, int l_lo, int l_hi,
+                        int nworkers, const char *path){
+
+    SweepCtx sw={ NULL, l_lo, l_hi };
+    EnsJob e={ "FCFS", arr, n, sizeof(Row), cmp_row, k, jitter, scale, seed, l_lo, l_hi-l_lo+1, summary_names,
+        0, ensemble_point, NULL, &sw };
+    return ens_run(&e,nworkers,path);
+}
+
+//sharded sweep (-w N): the segment holds this header and then the sorted trace
+typedef struct{
+    size_t n;
+    uint64_t hash;
+} ShmTrace;
+
+typedef struct{
+    const char *cache_dir;
+    int l_lo;
+} ShardCtx;
+
+static void shard_cell(void *ctx, const void *seg, int cell, FILE *f_details, FILE *f_summary){
+
+    ShardCtx *sc=(ShardCtx*)ctx;
+    const ShmTrace *hdr=(const ShmTrace*)seg;
+    const Row *arr=(const Row*)(hdr+1);
+    run_cell(arr, hdr->n, hdr->hash, sc->cache_dir, sc->l_lo+cell, f_details, f_summary);
+}
+
+static int run_sharded(const Row *arr, size_t n, uint64_t hash, const char *cache_dir, int l_lo, int l_hi, int nprocs,
+                       FILE *f_details, FILE *f_summary){
+
+    ShmTrace hdr={ n, hash };
+    ShardCtx sc={ cache_dir, l_lo };
+    ShardJob job={ "a2p1", &hdr, sizeof(hdr), arr, sizeof(Row)*n, l_hi-l_lo+1, shard_cell, &sc, "latency", l_lo };
+    return shard_run(&job,nprocs,f_details,f_summary);
+}
+
+static void usage(const char *prog){
+    fprintf(stderr,"usage: %s [-l MIN:MAX] [-c cache_dir] [-C] < trace.csv\n",prog);
+    fprintf(stderr,"       %s -b [-j threads] [-l MIN:MAX] [-c cache_dir] [-C] trace.csv...\n",prog);
+    fprintf(stderr,"       %s -w procs [-l MIN:MAX] [-c cache_dir] [-C] < trace.csv\n",prog);
+    fprintf(stderr,"       %s -e variants [-J jitter] [-S scale] [-s seed] [-j threads] [-l MIN:MAX] < trace.csv\n",prog);
+}
 
-        rows_push(&rs,r);
+int main(int argc, char **argv){
+
+    //latency sweep range and optional result cache
+    int l_lo=1, l_hi=200;
+    const char *cache_dir=NULL;
+    //batch mode takes trace files as arguments instead of stdin
+    int batch=0;
+    int nworkers=(int)sysconf(_SC_NPROCESSORS_ONLN);
+    //sharded mode splits the sweep over this many worker processes
+    int nprocs=0;
+    //ensemble mode: variant count and how each variant is perturbed
+    int ens_k=0;
+    int jitter=0;
+    double scale=0.0;
+    uint64_t seed=1;
+
+    int opt;
+    while((opt=getopt(argc,argv,"l:c:bj:w:e:J:S:s:C"))!=-1){
+        switch(opt){
+            case 'l':
+                if(!parse_range(optarg,0,&l_lo,&l_hi)){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'c':
+                cache_dir=optarg;
+                break;
+            case 'b':
+                batch=1;
+                break;
+            case 'j':
+                nworkers=atoi(optarg);
+                break;
+            case 'w':
+                nprocs=atoi(optarg);
+                if(nprocs<1){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'e':
+                ens_k=atoi(optarg);
+                if(ens_k<1){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'J':
+                jitter=atoi(optarg);
+                if(jitter<0){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'S':
+                scale=atof(optarg);
+                if(scale<0.0 || scale>1.0){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 's':
+                seed=strtoull(optarg,NULL,10);
+                break;
+            case 'C':
+                col_out=1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(cache_dir && mkdir(cache_dir,0777)!=0 && errno!=EEXIST){
+        fprintf(stderr,"cannot create cache directory %s\n",cache_dir);
+        return 1;
+    }
+
+    //an ensemble only produces the banded summary, the per run outputs and caches do not apply
+    if(ens_k && (batch || nprocs || cache_dir || col_out)){
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(batch){
+        if(optind==argc || nprocs){
+            usage(argv[0]);
+            return 1;
+        }
+        return run_batch(argv+optind,argc-optind,l_lo,l_hi,cache_dir,nworkers);
+    }
+
+    //read header and rows from stdin
+    Rows rs; rows_init(&rs);
+
+    if(!load_trace(stdin,"stdin",&rs)){
+        free(rs.data);
+        return 1;
     }
 
     //sort once by arrival, pid to enforce FCFS + tie-break
     qsort(rs.data, rs.size, sizeof(Row), cmp_row);
 
-    //open output files to write to
-    FILE *f_details = fopen("fcfs_results_details.csv","w");
-    //error check
-    if(!f_details){ 
-        fprintf(stderr,"cannot open fcfs_results_details.csv for write\n"); free(rs.data); 
-        return 1; 
+    if(ens_k){
+        int rc=run_ensemble(rs.data,rs.size,ens_k,jitter,scale,seed,l_lo,l_hi,nworkers,"fcfs_results.csv");
+        free(rs.data);
+        return rc;
     }
 
-    FILE *f_summary = fopen("fcfs_results.csv","w");
+    //open output files to write to
+    const char *details_path = col_out? "fcfs_results_details.col" : "fcfs_results_details.csv";
+    const char *summary_path = col_out? "fcfs_results.col" : "fcfs_results.csv";
+    FILE *f_details, *f_summary;
     //error check
-    if(!f_summary){ 
-        fprintf(stderr,"cannot open fcfs_results.csv for write\n"); fclose(f_details); free(rs.data); 
+    if(!open_outputs(details_path,summary_path,l_lo,l_hi,&f_details,&f_summary)){ 
+        fprintf(stderr,"cannot open %s or %s for write\n",details_path,summary_path); free(rs.data); 
         return 1; 
     }
 
     //write headers in files 
-    fprintf(f_details,"Scheduler_Latency,Pid,Arrival Time,Start Time,Finish Time,Turnaround Time,Waiting Time,Response Time\n");
-    
-    fprintf(f_summary,"Scheduler_Latency,Throughput,Avg_Waiting_Time,Avg_Turnaround_Time,Avg_Response_Time\n");
+    write_headers(f_details,f_summary);
 
     //simulate latency 
-    for(int L=1; L<=200; L++){
-        simulate_and_write(rs.data, rs.size, L, f_details, f_summary);
+    uint64_t hash=trace_hash(rs.data,rs.size,sizeof(Row));
+    if(nprocs){
+        if(run_sharded(rs.data,rs.size,hash,cache_dir,l_lo,l_hi,nprocs,f_details,f_summary)!=0){
+            fclose(f_details);
+            fclose(f_summary);
+            free(rs.data);
+            return 1;
+        }
+    }
+    else{
+        for(int L=l_lo; L<=l_hi; L++){
+            run_cell(rs.data, rs.size, hash, cache_dir, L, f_details, f_summary);
+        }
     }
 
-    printf("RR simulation completed! Results saved to fcfs_results.csv\n");
-    printf("Average results saved to fcfs_results_details.csv\n");
+    printf("RR simulation completed! Results saved to %s\n",summary_path);
+    printf("Average results saved to %s\n",details_path);
     
     fclose(f_details);
     fclose(f_summary);
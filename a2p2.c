@@ -1,17 +1,25 @@
 //a2p2
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+#define _GNU_SOURCE
+#include "sweep.h"
 
-//process has 4 values
+//bump whenever simulate_rr output changes so old cache entries stop matching
+#define CACHE_VERSION 2
+
+//process has 4 values, plus a priority from an optional fifth column
 typedef struct{
     int pid;
     int arrival;
     int first_resp;  
     int burst;
+    //position in the trace or variant, last tie-break so equal jobs always sort the same way
+    int index;
+    //0 is the most urgent, only the priority policy reads it
+    int prio;
 } Proc;
 
+_Static_assert(offsetof(Proc, index) == offsetof(JobHead, index), "Proc has to start with the JobHead fields");
+
 //process list
 typedef struct{
     Proc *data;
@@ -43,7 +51,7 @@ static void list_push(ProcList *pl, Proc p){
     pl->data[pl->size++] = p;
 }
 
-//sort by arrival then PID for tiebreak
+//sort by arrival then PID for tiebreak, then position so the order never depends on qsort
 static int cmp_proc(const void *a, const void *b){
 
     const Proc *x = (const Proc*)a, *y = (const Proc*)b;
@@ -54,7 +62,7 @@ static int cmp_proc(const void *a, const void *b){
     if (x->pid != y->pid){
         return (x->pid < y->pid)     ? -1 : 1;
     }
-    return 0;
+    return (x->index < y->index) ? -1 : (x->index > y->index);
 }
 
 //queue of ints that indexes into process array
@@ -140,66 +148,580 @@ static void q_free(procQueue *q) {
     q->cap = q->head = q->tail = 0;
 }
 
-//simulate round robin
-static void simulate_rr(const Proc *p, size_t n, int quantum, int latency, FILE *f_details, FILE *f_summary){
+//binary dispatch timeline: "RRTL" + version, then blocks of at most TL_BLOCK slices for one sweep point.
+//a block is varints: quantum, latency, count, first dispatch time, then per slice the zigzag pid delta,
+//the idle gap since the previous slice ended and the run length. an index of block offsets and time
+//ranges is written at the end so a reader can seek straight to a time window
+#define TL_BLOCK 4096
 
-    if (n == 0) return;
+typedef struct{
+    int64_t quantum;
+    int64_t first;
+    int64_t last_end;
+    uint64_t offset;
+} TLIndex;
+
+typedef struct{
+    FILE *f;
+    uint64_t off;
+    unsigned char *blk;
+    size_t blen;
+    int quantum;
+    int latency;
+    int64_t count;
+    int64_t first;
+    int64_t prev_end;
+    int64_t prev_pid;
+    TLIndex *idx;
+    size_t nidx;
+    size_t cidx;
+} Timeline;
+
+static size_t put_varint(unsigned char *b, uint64_t v){
+
+    size_t k = 0;
+    while (v >= 0x80){
+        b[k++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    b[k++] = (unsigned char)v;
+    return k;
+}
+
+static uint64_t zigzag(int64_t v){
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static Timeline *tl_open(const char *path){
+
+    Timeline *tl = calloc(1, sizeof(Timeline));
+    if (!tl){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    tl->f = fopen(path, "wb");
+    //worst case a slice takes three 10 byte varints
+    tl->blk = malloc(TL_BLOCK * 30);
+    if (!tl->f || !tl->blk){
+        fprintf(stderr, "cannot open timeline %s for write\n", path);
+        exit(1);
+    }
+    setvbuf(tl->f, NULL, _IOFBF, 1 << 16);
+
+    fwrite("RRTL\1", 1, 5, tl->f);
+    tl->off = 5;
+    return tl;
+}
+
+//write out the slices collected so far as one block and record it in the index
+static void tl_flush(Timeline *tl){
+
+    if (tl->count == 0){
+        return;
+    }
+
+    if (tl->nidx == tl->cidx){
+        tl->cidx = tl->cidx ? tl->cidx * 2 : 256;
+        TLIndex *tmp = realloc(tl->idx, tl->cidx * sizeof(TLIndex));
+        if (!tmp){
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        tl->idx = tmp;
+    }
+    TLIndex *e = &tl->idx[tl->nidx++];
+    e->quantum = tl->quantum;
+    e->first = tl->first;
+    e->last_end = tl->prev_end;
+    e->offset = tl->off;
+
+    unsigned char hdr[40];
+    size_t h = 0;
+    h += put_varint(hdr + h, (uint64_t)tl->quantum);
+    h += put_varint(hdr + h, (uint64_t)tl->latency);
+    h += put_varint(hdr + h, (uint64_t)tl->count);
+    h += put_varint(hdr + h, zigzag(tl->first));
+
+    fwrite(hdr, 1, h, tl->f);
+    fwrite(tl->blk, 1, tl->blen, tl->f);
+    tl->off += h + tl->blen;
+
+    tl->blen = 0;
+    tl->count = 0;
+}
+
+//start the slices of a new sweep point
+static void tl_begin(Timeline *tl, int quantum, int latency){
+    tl_flush(tl);
+    tl->quantum = quantum;
+    tl->latency = latency;
+}
+
+//one dispatch: the job runs for run units after the latency is charged at dispatch
+static inline void tl_slice(Timeline *tl, int pid, int64_t dispatch, int64_t run){
+
+    if (tl->count == 0){
+        tl->first = dispatch;
+        tl->prev_end = dispatch;
+        tl->prev_pid = 0;
+    }
+
+    unsigned char *b = tl->blk + tl->blen;
+    size_t k = put_varint(b, zigzag(pid - tl->prev_pid));
+    k += put_varint(b + k, (uint64_t)(dispatch - tl->prev_end));
+    k += put_varint(b + k, (uint64_t)run);
+    tl->blen += k;
+
+    tl->prev_pid = pid;
+    tl->prev_end = dispatch + tl->latency + run;
+
+    if (++tl->count == TL_BLOCK){
+        tl_flush(tl);
+    }
+}
+
+//index entries are fixed width so the reader can load them with one read, the footer points at them
+static void tl_close(Timeline *tl){
+
+    tl_flush(tl);
+
+    uint64_t index_off = tl->off;
+    uint64_t nidx = tl->nidx;
+    fwrite(&nidx, sizeof(nidx), 1, tl->f);
+    fwrite(tl->idx, sizeof(TLIndex), tl->nidx, tl->f);
+    fwrite(&index_off, sizeof(index_off), 1, tl->f);
+    fwrite("RRTE", 1, 4, tl->f);
+
+    if (fclose(tl->f) != 0){
+        fprintf(stderr, "cannot write timeline\n");
+    }
+    free(tl->blk);
+    free(tl->idx);
+    free(tl);
+}
+
+static const char *const detail_names[] = { "Quantum_size", "Pid", "Arrival Time", "Start Time", "Finish Time",
+    "Turnaround Time", "Waiting Time", "Response Time" };
+static const char *const summary_names[] = { "Quantum_size", "Throughput", "Avg_Waiting_Time", "Avg_Turnaround_Time",
+    "Avg_Response_Time" };
+
+//open the pair of outputs in the selected format, returns 0 and closes whatever did open on failure
+static int open_outputs(const char *details, const char *summary, int q_lo, int q_hi, int latency,
+                        FILE **f_details, FILE **f_summary){
+
+    if (col_out){
+        *f_details = col_open(details, "Quantum_size", q_lo, q_hi, latency, 8, "iiiiiiii", detail_names);
+        *f_summary = col_open(summary, "Quantum_size", q_lo, q_hi, latency, 5, "ifddd", summary_names);
+    } 
+    else{
+        *f_details = fopen(details, "w");
+        *f_summary = fopen(summary, "w");
+    }
+
+    if (!*f_details || !*f_summary){
+        if (*f_details) fclose(*f_details);
+        if (*f_summary) fclose(*f_summary);
+        return 0;
+    }
+    return 1;
+}
+
+//trace characterization, one pass over the sorted trace before the sweep picks an engine per quantum
+#define HIST_BINS 32
+
+typedef struct{
+    size_t n;
+    int max_burst;
+    double mean_burst;
+    int64_t span;
+    //arrivals per equal slice of the arrival span
+    int64_t hist[HIST_BINS];
+    //peak offered load: burst work arriving in the busiest bin over the bin width,
+    //roughly how many jobs want the cpu at once at the worst point of the trace
+    double peak_load;
+} TraceStats;
+
+static void trace_stats(const Proc *p, size_t n, TraceStats *ts){
+
+    memset(ts, 0, sizeof(*ts));
+    ts->n = n;
+    if (n == 0){
+        return;
+    }
+
+    int64_t first = p[0].arrival;
+    ts->span = (int64_t)p[n - 1].arrival - first;
+    double scale = (double)HIST_BINS / (double)(ts->span + 1);
+    double work[HIST_BINS] = { 0 };
+
+    //max and sum get a loop of their own, the histogram's scattered stores would keep it from vectorizing.
+    //gcc vectorizes it at -O3, its -O2 cost model leaves alone any loop that needs a scalar tail
+    int max_burst = 0;
+    int64_t sum_burst = 0;
+    for (size_t i = 0; i < n; i++){
+        int b = p[i].burst;
+        max_burst = b > max_burst ? b : max_burst;
+        sum_burst += b;
+    }
+
+    for (size_t i = 0; i < n; i++){
+        int bin = (int)((double)(p[i].arrival - first) * scale);
+        ts->hist[bin]++;
+        work[bin] += p[i].burst;
+    }
+
+    ts->max_burst = max_burst;
+    ts->mean_burst = (double)sum_burst / (double)n;
 
-    int *rem = malloc(sizeof(int) * n);
-    int *first_start = malloc(sizeof(int) * n);
-    int *finish = malloc(sizeof(int) * n);
+    double width = (double)(ts->span + 1) / HIST_BINS;
+    for (int k = 0; k < HIST_BINS; k++){
+        double load = work[k] / (width > 1.0 ? width : 1.0);
+        ts->peak_load = load > ts->peak_load ? load : ts->peak_load;
+    }
+}
+
+typedef enum{
+    ENGINE_STEP,
+    ENGINE_SKIP,
+    ENGINE_FCFS
+} Engine;
+
+static const char *const engine_names[] = { "step", "skip", "fcfs" };
+
+//fcfs: with quantum >= every burst each dispatch runs its job to completion in queue order, so the queue
+//can be dropped. it only snapshots the final state, so it is not used when a checkpoint is being taken.
+//skip: jumps over whole rounds when nothing arrives, pays off when a few long jobs share the cpu.
+//step: the plain loop, best when the queue is long and arrivals keep interrupting rounds
+static Engine choose_engine(const TraceStats *ts, int quantum, int allow_fcfs, int allow_skip){
+
+    if (!ts){
+        return ENGINE_STEP;
+    }
+    if (allow_fcfs && quantum >= ts->max_burst){
+        return ENGINE_FCFS;
+    }
+    if (allow_skip && ts->mean_burst >= 4.0 * quantum && ts->peak_load <= 2.0){
+        return ENGINE_SKIP;
+    }
+    return ENGINE_STEP;
+}
+
+//write the stats and the engine each sweep point will use next to the results
+static void write_meta(const char *path, const TraceStats *ts, int q_lo, int q_hi, int allow_fcfs, int allow_skip){
+
+    FILE *f = fopen(path, "w");
+    if (!f){
+        fprintf(stderr, "cannot open %s for write\n", path);
+        return;
+    }
+
+    fprintf(f, "# jobs=%zu max_burst=%d mean_burst=%.2f arrival_span=%lld peak_load=%.2f\n", ts->n, ts->max_burst,
+        ts->mean_burst, (long long)ts->span, ts->peak_load);
+    fprintf(f, "# arrival_histogram=");
+    for (int k = 0; k < HIST_BINS; k++){
+        fprintf(f, "%s%lld", k ? " " : "", (long long)ts->hist[k]);
+    }
+    fprintf(f, "\nQuantum_size,Engine\n");
+
+    for (int q = q_lo; q <= q_hi; q++){
+        fprintf(f, "%d,%s\n", q, engine_names[choose_engine(ts, q, allow_fcfs, allow_skip)]);
+    }
+    fclose(f);
+}
+
+//everything the rr loop needs to stop at a slice boundary and carry on later.
+//the clock and the times derived from it are 64 bit since a long trace runs far past INT_MAX,
+//while rem never exceeds a burst and stays 32 bit like the fields of Proc
+typedef struct{
+    int64_t time;
+    size_t next_arr;
+    int done;
+    int64_t last_finish;
+    int *rem;
+    int64_t *first_start;
+    int64_t *finish;
+    //indices in the order they finished, so detail rows can be written again on resume
+    int *order;
+    procQueue rq;
+} RRState;
+
+//snapshot of one sweep point, taken at the first slice boundary after the last known job was admitted
+typedef struct{
+    int valid;
+    int quantum;
+    int latency;
+    //trace the snapshot came from: its length and the hash of those sorted rows
+    size_t n;
+    uint64_t hash;
+    RRState st;
+} RRSnap;
+
+static void rr_alloc(RRState *st, size_t n){
+
+    st->rem = malloc(sizeof(int) * n);
+    st->first_start = malloc(sizeof(int64_t) * n);
+    st->finish = malloc(sizeof(int64_t) * n);
+    st->order = malloc(sizeof(int) * n);
 
     //check to see if there is enouogh memory
-    if (!rem || !first_start || !finish){
+    if (!st->rem || !st->first_start || !st->finish || !st->order){
         fprintf(stderr, "out of memory\n");
         exit(1);
     }
+}
+
+static void rr_free(RRState *st){
+    q_free(&st->rq);
+    free(st->rem);
+    free(st->first_start);
+    free(st->finish);
+    free(st->order);
+}
+
+//fresh state at the first arrival
+static void rr_init(RRState *st, const Proc *p, size_t n){
+
+    rr_alloc(st, n);
 
     //initialize arrays
     for (size_t i = 0; i < n; i++){
 
         //remaining for process is the full burst time
-        rem[i] = p[i].burst;
-        first_start[i] = -1;
-        finish[i] = -1;
+        st->rem[i] = p[i].burst;
+        st->first_start[i] = -1;
+        st->finish[i] = -1;
     }
 
     //create procQueue and allocate space
-    procQueue rq;
-    q_init(&rq, (int)n * 2 + 4);
+    q_init(&st->rq, (int)n * 2 + 4);
 
     //rr simulation clock
-    int time = 0;
+    st->time = 0;
     //index of the next process set by arrival time
-    size_t next_arr = 0;
+    st->next_arr = 0;
     //how many process are done
-    int done = 0;
+    st->done = 0;
 
     //start clock at first arrival time
-    if (next_arr < n){
-        time = p[next_arr].arrival;
+    if (st->next_arr < n){
+        st->time = p[st->next_arr].arrival;
     }
-    while (next_arr < n && p[next_arr].arrival <= time){
-        q_push(&rq, (int)next_arr);
-        next_arr++;
+    while (st->next_arr < n && p[st->next_arr].arrival <= st->time){
+        q_push(&st->rq, (int)st->next_arr);
+        st->next_arr++;
     }
 
-    //check arrival time to calculate thruput
-    int first_arrival = p[0].arrival;
-    int last_finish = time;
+    st->last_finish = st->time;
+}
+
+//copy a state, only the live part of the ready queue is kept
+static void rr_copy(RRState *dst, const RRState *src, size_t n){
+
+    rr_alloc(dst, n);
+    memcpy(dst->rem, src->rem, sizeof(int) * n);
+    memcpy(dst->first_start, src->first_start, sizeof(int64_t) * n);
+    memcpy(dst->finish, src->finish, sizeof(int64_t) * n);
+    memcpy(dst->order, src->order, sizeof(int) * src->done);
+
+    q_init(&dst->rq, src->rq.tail - src->rq.head);
+    for (int k = src->rq.head; k < src->rq.tail; k++){
+        q_push(&dst->rq, src->rq.buf[k]);
+    }
+
+    dst->time = src->time;
+    dst->next_arr = src->next_arr;
+    dst->done = src->done;
+    dst->last_finish = src->last_finish;
+}
+
+static void write_detail(FILE *f_details, const Proc *p, const RRState *st, int i, int quantum){
+
+    //ensemble runs keep no per job rows
+    if (!f_details){
+        return;
+    }
+
+    //calculate values
+    int64_t turnaround = st->finish[i] - p[i].arrival;
+    int64_t waiting = turnaround - p[i].burst;
+    int64_t response = (st->first_start[i] - p[i].arrival) + p[i].first_resp;
+
+    if (col_out){
+        int64_t rec[8] = { quantum, p[i].pid, p[i].arrival, st->first_start[i], st->finish[i], turnaround, waiting, response };
+        fwrite(rec, sizeof(rec), 1, f_details);
+        return;
+    }
+
+    //write values to file
+    fprintf(f_details, "%d,%d,%d,%lld,%lld,%lld,%lld,%lld\n", quantum, p[i].pid, p[i].arrival, (long long)st->first_start[i],
+        (long long)st->finish[i], (long long)turnaround, (long long)waiting, (long long)response);
+}
+
+//a snapshot can stand in for the start of a run if the trace still begins with the same jobs
+//and everything appended arrives after the snapshot clock
+static int snap_usable(const RRSnap *s, const Proc *p, size_t n, int quantum, int latency){
+
+    if (!s || !s->valid || s->quantum != quantum || s->latency != latency){
+        return 0;
+    }
+    if (s->n > n || trace_hash(p, s->n, sizeof(Proc)) != s->hash){
+        return 0;
+    }
+    return s->n == n || p[s->n].arrival > s->st.time;
+}
+
+//rebuild a full size state for the n job trace from a snapshot of its first s->n jobs
+static void rr_restore(RRState *st, const RRSnap *s, const Proc *p, size_t n){
+
+    rr_alloc(st, n);
+
+    for (size_t i = 0; i < n; i++){
+        st->rem[i] = i < s->n ? s->st.rem[i] : p[i].burst;
+        st->first_start[i] = i < s->n ? s->st.first_start[i] : -1;
+        st->finish[i] = i < s->n ? s->st.finish[i] : -1;
+    }
+    memcpy(st->order, s->st.order, sizeof(int) * s->st.done);
+
+    q_init(&st->rq, (int)n * 2 + 4);
+    for (int k = s->st.rq.head; k < s->st.rq.tail; k++){
+        q_push(&st->rq, s->st.rq.buf[k]);
+    }
+
+    st->time = s->st.time;
+    st->next_arr = s->st.next_arr;
+    st->done = s->st.done;
+    st->last_finish = s->st.last_finish;
+}
+
+//take a snapshot of the current slice boundary
+static void snap_take(RRSnap *s, const RRState *st, size_t n){
+    rr_copy(&s->st, st, n);
+    s->valid = 1;
+}
+
+//skip engine: at a slice boundary, jump over as many full rounds of the ready queue as possible.
+//a round is a full quantum for every queued job in queue order, which leaves the queue as it was, so it can
+//be repeated while no job would finish and nothing arrives. returns how many slices to wait before trying again
+static int rr_skip_rounds(RRState *st, const Proc *p, size_t n, int quantum, int latency){
+
+    int m = st->rq.tail - st->rq.head;
+    if (m == 0){
+        return 1;
+    }
+
+    int min_rem = INT_MAX;
+    for (int k = st->rq.head; k < st->rq.tail; k++){
+        int i = st->rq.buf[k];
+        //first_start of a job that has not run yet would have to be placed inside the round
+        if (st->first_start[i] == -1){
+            return m;
+        }
+        min_rem = st->rem[i] < min_rem ? st->rem[i] : min_rem;
+    }
+
+    int64_t round = (int64_t)m * (latency + quantum);
+    int64_t k = (min_rem - 1) / quantum;
+
+    //the last skipped slice has to end before the next arrival
+    if (st->next_arr < n){
+        int64_t by_arrival = (p[st->next_arr].arrival - st->time - 1) / round;
+        k = by_arrival < k ? by_arrival : k;
+    }
+
+    if (k > 0){
+        for (int j = st->rq.head; j < st->rq.tail; j++){
+            st->rem[st->rq.buf[j]] -= (int)(k * quantum);
+        }
+        st->time += k * round;
+    }
+    return m;
+}
+
+//fcfs engine, only valid when quantum >= every remaining burst: the queue drains in order, then the
+//jobs still to arrive run in arrival order, each in one slice
+static void rr_run_fcfs(RRState *st, const Proc *p, size_t n, int latency, int quantum, FILE *f_details, Timeline *tl){
+
+    while (st->done < (int)n){
+        int i;
+        if (!q_empty(&st->rq)){
+            i = q_pop(&st->rq);
+        } 
+        else if (st->next_arr < n){
+            i = (int)st->next_arr++;
+            if (st->time < p[i].arrival){
+                st->time = p[i].arrival;
+            }
+        } 
+        else{
+            break;
+        }
+
+        if (tl){
+            tl_slice(tl, p[i].pid, st->time, st->rem[i]);
+        }
+
+        st->time += latency;
+        if (st->first_start[i] == -1){
+            st->first_start[i] = st->time;
+        }
+        st->time += st->rem[i];
+        st->rem[i] = 0;
+
+        st->finish[i] = st->time;
+        st->last_finish = st->time;
+        st->order[st->done] = i;
+        write_detail(f_details, p, st, i, quantum);
+        st->done++;
+    }
+
+    //admit anything that arrived by the end so next_arr means the same as after the step loop
+    while (st->next_arr < n && p[st->next_arr].arrival <= st->time){
+        st->next_arr++;
+    }
+}
+
+//run the rr loop to completion, taking a snapshot into save once every job has been admitted
+//and one into fork right before the first slice that the quantum cuts short
+static void rr_run(RRState *st, const Proc *p, size_t n, int quantum, int latency, FILE *f_details, RRSnap *save,
+                   RRSnap *fork, Timeline *tl, Engine engine){
+
+    if (engine == ENGINE_FCFS){
+        rr_run_fcfs(st, p, n, latency, quantum, f_details, tl);
+    }
+
+    int skip = engine == ENGINE_SKIP;
+    int until_scan = 1;
 
     //loop through the queue
-    while (done < (int)n){
+    while (st->done < (int)n){
+
+        //every loop top is a slice boundary, the first one with no jobs left to admit is the checkpoint
+        if (save && !save->valid && st->next_arr == n){
+            snap_take(save, st, n);
+        }
+
+        //until a job with more than a quantum left is dispatched, every slice runs the job to completion,
+        //so any larger quantum produces exactly the same schedule up to this point
+        if (fork && !fork->valid && !q_empty(&st->rq) && st->rem[st->rq.buf[st->rq.head]] > quantum){
+            snap_take(fork, st, n);
+        }
+
+        //about once per round, see whether whole rounds can be skipped
+        if (skip && --until_scan <= 0){
+            until_scan = rr_skip_rounds(st, p, n, quantum, latency);
+        }
+
         //check to see if a process is ready
-        if (q_empty(&rq)){
+        if (q_empty(&st->rq)){
             //if another process arrive before an existing one can start, start with the next process
-            if (next_arr < n){
-                time = p[next_arr].arrival;
+            if (st->next_arr < n){
+                st->time = p[st->next_arr].arrival;
                 //start whatever is available
-                while (next_arr < n && p[next_arr].arrival <= time){
+                while (st->next_arr < n && p[st->next_arr].arrival <= st->time){
                     //add to the ready queue
-                    q_push(&rq, (int)next_arr);
-                    next_arr++;
+                    q_push(&st->rq, (int)st->next_arr);
+                    st->next_arr++;
                 }
                 continue;
             } 
@@ -209,136 +731,1175 @@ static void simulate_rr(const Proc *p, size_t n, int quantum, int latency, FILE
         }
 
         //start next process
-        int i = q_pop(&rq);
+        int i = q_pop(&st->rq);
 
         //account for latency
-        time += latency;
+        st->time += latency;
 
-        if (first_start[i] == -1){
-            first_start[i] = time;
+        if (st->first_start[i] == -1){
+            st->first_start[i] = st->time;
         }
 
         //calculaate slice length, and reduce the remaining time by how much has already been processed
-        int run = (rem[i] < quantum) ? rem[i] : quantum;
-        time += run;
-        rem[i] -= run;
+        int run = (st->rem[i] < quantum) ? st->rem[i] : quantum;
+
+        if (tl){
+            tl_slice(tl, p[i].pid, st->time - latency, run);
+        }
+        st->time += run;
+        st->rem[i] -= run;
 
         //if there is any new processes that have arrived, add them to the queue
-        while (next_arr < n && p[next_arr].arrival <= time){
-            q_push(&rq, (int)next_arr);
-            next_arr++;
+        while (st->next_arr < n && p[st->next_arr].arrival <= st->time){
+            q_push(&st->rq, (int)st->next_arr);
+            st->next_arr++;
         }
 
         //check to see if the current process still has work left, if it does then add it back to te queue
-        if (rem[i] > 0){
-            q_push(&rq, i);
+        if (st->rem[i] > 0){
+            q_push(&st->rq, i);
         } 
         //if the process is finished
         else {
-            finish[i] = time;
-            last_finish = time;
+            st->finish[i] = st->time;
+            st->last_finish = st->time;
+            st->order[st->done] = i;
 
-            //calculate values
-            int turnaround = finish[i] - p[i].arrival;
-            int waiting = turnaround - p[i].burst;
-            int response = (first_start[i] - p[i].arrival) + p[i].first_resp;
-            
-            //write values to file
-            fprintf(f_details, "%d,%d,%d,%d,%d,%d,%d,%d\n", quantum, p[i].pid, p[i].arrival, first_start[i], finish[i], 
-                turnaround, waiting, response);
+            write_detail(f_details, p, st, i, quantum);
 
-            done++;
+            st->done++;
         }
     }
 
-    double sum_wait = 0.0;
-    double sum_turn = 0.0;
-    double sum_resp = 0.0;
+    //never cut short, or resumed past the end: the final state is still a valid snapshot
+    if (save && !save->valid && st->next_arr == n){
+        snap_take(save, st, n);
+    }
+    if (fork && !fork->valid){
+        snap_take(fork, st, n);
+    }
+}
+
+//kahan compensated sum, per job times reach the billions and a plain double loses the low digits of the total
+typedef struct{
+    double sum;
+    double c;
+} KSum;
+
+static void ksum_add(KSum *k, double v){
+    double y = v - k->c;
+    double t = k->sum + y;
+    k->c = (t - k->sum) - y;
+    k->sum = t;
+}
+
+//throughput, average waiting, turnaround and response time of a finished run
+static void rr_metrics(const RRState *st, const Proc *p, size_t n, double vals[4]){
+
+    KSum sum_wait = { 0.0, 0.0 };
+    KSum sum_turn = { 0.0, 0.0 };
+    KSum sum_resp = { 0.0, 0.0 };
 
     //loop to sum up wait times, turnaround times and response times
     for (size_t i = 0; i < n; i++){
 
-        int turnaround = finish[i] - p[i].arrival;
-        int waiting = turnaround - p[i].burst;
-        int response = (first_start[i] - p[i].arrival) + p[i].first_resp;
+        int64_t turnaround = st->finish[i] - p[i].arrival;
+        int64_t waiting = turnaround - p[i].burst;
+        int64_t response = (st->first_start[i] - p[i].arrival) + p[i].first_resp;
 
-        sum_turn += turnaround;
-        sum_wait += waiting;
-        sum_resp += response;
+        ksum_add(&sum_turn, (double)turnaround);
+        ksum_add(&sum_wait, (double)waiting);
+        ksum_add(&sum_resp, (double)response);
     }
 
+    //check arrival time to calculate thruput
+    int first_arrival = p[0].arrival;
+
     //sum divided by number of jobs
     double dn = n;
-    double avg_wait = sum_wait/dn;
-    double avg_turn = sum_turn/dn;
-    double avg_resp = sum_resp/dn;
-    double elapsed = last_finish - first_arrival;
+    double avg_wait = sum_wait.sum/dn;
+    double avg_turn = sum_turn.sum/dn;
+    double avg_resp = sum_resp.sum/dn;
+    double elapsed = (double)(st->last_finish - first_arrival);
     double throughput = dn/elapsed;
 
-    fprintf(f_summary, "%d,%.6f,%.2f,%.2f,%.2f\n", quantum, throughput, avg_wait, avg_turn, avg_resp);
+    vals[0] = throughput;
+    vals[1] = avg_wait;
+    vals[2] = avg_turn;
+    vals[3] = avg_resp;
+}
+
+static void rr_summary(const RRState *st, const Proc *p, size_t n, int quantum, FILE *f_summary){
+
+    double vals[4];
+    rr_metrics(st, p, n, vals);
+
+    if (col_out){
+        int64_t q = quantum;
+        fwrite(&q, sizeof(q), 1, f_summary);
+        fwrite(vals, sizeof(vals), 1, f_summary);
+        return;
+    }
+
+    fprintf(f_summary, "%d,%.6f,%.2f,%.2f,%.2f\n", quantum, vals[0], vals[1], vals[2], vals[3]);
+}
+
+//optional extras for one simulate_rr call, any of them may be NULL
+typedef struct{
+    //checkpoint to resume from, and where to leave one for the next append
+    const RRSnap *from;
+    RRSnap *save;
+    //shared prefix handed along an ascending quantum sweep
+    RRSnap *fork;
+    Timeline *tl;
+    //trace stats, lets simulate_rr pick a faster engine
+    const TraceStats *ts;
+    //when set the four summary values land here instead of in f_summary
+    double *metrics;
+} RROpts;
+
+//a fork from a smaller quantum of the same sweep is a valid start for any larger quantum
+static int fork_usable(const RRSnap *s, size_t n, int quantum, int latency){
+    return s && s->valid && s->n == n && s->quantum < quantum && s->latency == latency;
+}
+
+//simulate round robin, optionally picking up from a snapshot and leaving one behind for the next append.
+//fork carries the shared prefix along an ascending quantum sweep: it is read if it came from a smaller
+//quantum and then replaced with this quantum's own divergence point
+static void simulate_rr(const Proc *p, size_t n, int quantum, int latency, FILE *f_details, FILE *f_summary,
+                        const RROpts *o){
+
+    if (n == 0) return;
+
+    static const RROpts none;
+    if (!o){
+        o = &none;
+    }
+    const RRSnap *from = o->from;
+    RRSnap *save = o->save;
+    RRSnap *fork = o->fork;
+    Timeline *tl = o->tl;
+
+    RRState st;
+    int use_from = snap_usable(from, p, n, quantum, latency);
+    int use_fork = fork_usable(fork, n, quantum, latency);
+
+    //both are exact, start from whichever got further
+    if (use_from && use_fork){
+        use_from = from->st.time > fork->st.time;
+        use_fork = !use_from;
+    }
+
+    if (use_from){
+        rr_restore(&st, from, p, n);
+    } 
+    else if (use_fork){
+        rr_copy(&st, &fork->st, n);
+    }
+    else{
+        rr_init(&st, p, n);
+    }
+
+    //jobs that finished before the snapshot keep their rows, in the same order
+    for (int k = 0; k < st.done; k++){
+        write_detail(f_details, p, &st, st.order[k], quantum);
+    }
+
+    if (fork){
+        if (fork->valid){
+            rr_free(&fork->st);
+        }
+        fork->valid = 0;
+        fork->quantum = quantum;
+        fork->latency = latency;
+        fork->n = n;
+    }
+
+    //a checkpoint may already be past this quantum's divergence point, so no fork can be taken from it
+    if (use_from){
+        fork = NULL;
+    }
+
+    if (save){
+        if (save->valid){
+            rr_free(&save->st);
+        }
+        save->valid = 0;
+        save->quantum = quantum;
+        save->latency = latency;
+        save->n = n;
+        save->hash = trace_hash(p, n, sizeof(Proc));
+    }
+
+    if (tl){
+        tl_begin(tl, quantum, latency);
+    }
+
+    //skipping rounds would drop slices from the timeline
+    Engine engine = choose_engine(o->ts, quantum, save == NULL, tl == NULL);
+    rr_run(&st, p, n, quantum, latency, f_details, save, fork, tl, engine);
+    if (o->metrics){
+        rr_metrics(&st, p, n, o->metrics);
+    }
+    else{
+        rr_summary(&st, p, n, quantum, f_summary);
+    }
+    rr_free(&st);
+}
+
+//priority preemptive scheduling with aging. level 0 is the most urgent, a job enters at the priority from
+//the trace and every aging interval each waiting job moves up one level, so nothing waits forever.
+//the ready set is one fifo per level in a ring with a rotating base: aging is then a single splice of
+//level 0 and level 1 plus a base shift, and a 64 bit bitmap finds the best level in one instruction
+#define PRIO_LEVELS 64
+
+typedef struct{
+    int head[PRIO_LEVELS];
+    int tail[PRIO_LEVELS];
+    //next job in the same level, -1 at the tail
+    int *next;
+    //bit s set when ring slot s is non empty
+    uint64_t bits;
+    //ring slot of level 0
+    unsigned base;
+} PrioQueue;
+
+static void pq_init(PrioQueue *pq, size_t n){
+
+    for (int s = 0; s < PRIO_LEVELS; s++){
+        pq->head[s] = -1;
+        pq->tail[s] = -1;
+    }
+    pq->next = malloc(sizeof(int) * (n ? n : 1));
+    if (!pq->next){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    pq->bits = 0;
+    pq->base = 0;
+}
+
+//the bitmap turned so bit k stands for level k
+static uint64_t pq_levels(const PrioQueue *pq){
 
-    q_free(&rq);
-    free(rem);
-    free(first_start);
-    free(finish);
+    unsigned b = pq->base % PRIO_LEVELS;
+    return b ? (pq->bits >> b) | (pq->bits << (PRIO_LEVELS - b)) : pq->bits;
 }
 
-int main(void){
+//best non empty level, -1 when nothing is waiting
+static int pq_best(const PrioQueue *pq){
+    return pq->bits ? __builtin_ctzll(pq_levels(pq)) : -1;
+}
+
+//aging only changes something while a job waits below level 0
+static int pq_can_age(const PrioQueue *pq){
+    return pq_levels(pq) > 1;
+}
+
+static void pq_push(PrioQueue *pq, int i, int level){
+
+    int s = (int)((pq->base + (unsigned)level) % PRIO_LEVELS);
+    pq->next[i] = -1;
+    if (pq->head[s] == -1){
+        pq->head[s] = i;
+    }
+    else{
+        pq->next[pq->tail[s]] = i;
+    }
+    pq->tail[s] = i;
+    pq->bits |= 1ULL << s;
+}
+
+//take the oldest job of the best level, its level is left in *level
+static int pq_pop(PrioQueue *pq, int *level){
+
+    *level = pq_best(pq);
+    int s = (int)((pq->base + (unsigned)*level) % PRIO_LEVELS);
+    int i = pq->head[s];
+
+    pq->head[s] = pq->next[i];
+    if (pq->head[s] == -1){
+        pq->tail[s] = -1;
+        pq->bits &= ~(1ULL << s);
+    }
+    return i;
+}
+
+//one aging step: level 0 goes in front of level 1 and that becomes the new level 0,
+//every other level moves up by one with the base, the old level 0 slot is the new empty level 63
+static void pq_age(PrioQueue *pq){
+
+    int s0 = (int)(pq->base % PRIO_LEVELS);
+    int s1 = (int)((pq->base + 1) % PRIO_LEVELS);
+
+    if (pq->head[s0] != -1){
+        if (pq->head[s1] == -1){
+            pq->tail[s1] = pq->tail[s0];
+        }
+        else{
+            pq->next[pq->tail[s0]] = pq->head[s1];
+        }
+        pq->head[s1] = pq->head[s0];
+        pq->bits |= 1ULL << s1;
+
+        pq->head[s0] = -1;
+        pq->tail[s0] = -1;
+        pq->bits &= ~(1ULL << s0);
+    }
+    pq->base++;
+}
+
+//admit arrivals and apply aging ticks up to time, in time order, a tick going first when both fall together
+static void prio_catch_up(PrioQueue *pq, const Proc *p, size_t n, size_t *next_arr, int64_t *next_age, int aging,
+                          int64_t time){
+
+    for (;;){
+        int64_t arr = *next_arr < n ? p[*next_arr].arrival : INT64_MAX;
+
+        if (*next_age <= time && *next_age <= arr){
+            if (pq_can_age(pq)){
+                pq_age(pq);
+                *next_age += aging;
+            }
+            else{
+                //ticks before the next arrival or now change nothing, jump past them
+                int64_t upto = arr < time ? arr : time;
+                *next_age += ((upto - *next_age) / aging + 1) * aging;
+            }
+        }
+        else if (arr <= time){
+            pq_push(pq, (int)*next_arr, p[*next_arr].prio);
+            (*next_arr)++;
+        }
+        else{
+            break;
+        }
+    }
+}
+
+//simulate priority scheduling for one aging interval. a dispatch costs latency like an rr slice, a waiting
+//job takes the cpu as soon as its level is strictly better than the running job's, and a preempted job
+//goes back at the level it was running at
+static void simulate_prio(const Proc *p, size_t n, int aging, int latency, FILE *f_details, FILE *f_summary){
+
+    if (n == 0) return;
+
+    //same bookkeeping as rr so the detail and summary writers apply unchanged
+    RRState st;
+    rr_alloc(&st, n);
+    q_init(&st.rq, 1);
+    for (size_t i = 0; i < n; i++){
+        st.rem[i] = p[i].burst;
+        st.first_start[i] = -1;
+        st.finish[i] = -1;
+    }
+    st.time = p[0].arrival;
+    st.next_arr = 0;
+    st.done = 0;
+    st.last_finish = st.time;
+
+    PrioQueue pq;
+    pq_init(&pq, n);
+    int64_t next_age = st.time + aging;
+
+    int run = -1;
+    int run_level = 0;
+
+    while (st.done < (int)n){
+        prio_catch_up(&pq, p, n, &st.next_arr, &next_age, aging, st.time);
+
+        //ties stay with the running job
+        if (run >= 0 && pq.bits && pq_best(&pq) < run_level){
+            pq_push(&pq, run, run_level);
+            run = -1;
+        }
+
+        if (run < 0){
+            //nothing ready, idle until the next arrival
+            if (!pq.bits){
+                st.time = p[st.next_arr].arrival;
+                continue;
+            }
+            run = pq_pop(&pq, &run_level);
+            st.time += latency;
+            if (st.first_start[run] == -1){
+                st.first_start[run] = st.time;
+            }
+            continue;
+        }
+
+        //run until the job finishes or the next event that could preempt it
+        int64_t stop = st.time + st.rem[run];
+        if (st.next_arr < n && p[st.next_arr].arrival < stop){
+            stop = p[st.next_arr].arrival;
+        }
+        if (pq_can_age(&pq) && next_age < stop){
+            stop = next_age;
+        }
+
+        st.rem[run] -= (int)(stop - st.time);
+        st.time = stop;
+
+        if (st.rem[run] == 0){
+            st.finish[run] = st.time;
+            st.last_finish = st.time;
+            st.order[st.done] = run;
+            write_detail(f_details, p, &st, run, aging);
+            st.done++;
+            run = -1;
+        }
+    }
+
+    rr_summary(&st, p, n, aging, f_summary);
+    free(pq.next);
+    rr_free(&st);
+}
+
+//sweep the aging interval, output follows the rr schema with Aging_Interval as the first column
+static int run_prio(const Proc *p, size_t n, int a_lo, int a_hi, int latency){
+
+    const char *details_path = "prio_results_details.csv";
+    const char *summary_path = "prio_results.csv";
+    FILE *f_details = fopen(details_path, "w");
+    FILE *f_summary = fopen(summary_path, "w");
+    if (!f_details || !f_summary){
+        fprintf(stderr, "cannot open %s or %s for write\n", details_path, summary_path);
+        if (f_details) fclose(f_details);
+        if (f_summary) fclose(f_summary);
+        return 1;
+    }
+
+    fprintf(f_details, "Aging_Interval,Pid,Arrival Time,Start Time,Finish Time,Turnaround Time,Waiting Time,Response Time\n");
+    fprintf(f_summary, "Aging_Interval,Throughput,Avg_Waiting_Time,Avg_Turnaround_Time,Avg_Response_Time\n");
+
+    for (int a = a_lo; a <= a_hi; a++){
+        simulate_prio(p, n, a, latency, f_details, f_summary);
+    }
+
+    printf("Priority simulation completed! Results saved to %s\n", summary_path);
+    printf("Average results saved to %s\n", details_path);
+
+    fclose(f_details);
+    fclose(f_summary);
+    return 0;
+}
+
+static void put_i32(FILE *f, int32_t v){
+    fwrite(&v, sizeof(v), 1, f);
+}
+
+static int get_i32(FILE *f, int32_t *v){
+    return fread(v, sizeof(*v), 1, f) == 1;
+}
+
+static void put_i64(FILE *f, int64_t v){
+    fwrite(&v, sizeof(v), 1, f);
+}
+
+static int get_i64(FILE *f, int64_t *v){
+    return fread(v, sizeof(*v), 1, f) == 1;
+}
+
+//checkpoint file: "RRCK", version, count, then per snapshot its key and the done and queued jobs.
+//every job is either done or queued at the snapshot, so untouched rem/first_start/finish entries are not stored
+static int save_ckpt(const char *path, const RRSnap *snaps, int count){
+
+    char tmp[4200];
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f){
+        return 0;
+    }
+
+    fwrite("RRCK", 1, 4, f);
+    put_i32(f, 2);
+
+    int valid = 0;
+    for (int k = 0; k < count; k++){
+        valid += snaps[k].valid;
+    }
+    put_i32(f, valid);
+
+    for (int k = 0; k < count; k++){
+        const RRSnap *s = &snaps[k];
+        if (!s->valid){
+            continue;
+        }
+
+        put_i32(f, s->quantum);
+        put_i32(f, s->latency);
+        put_i32(f, (int32_t)s->n);
+        fwrite(&s->hash, sizeof(s->hash), 1, f);
+        put_i64(f, s->st.time);
+        put_i32(f, s->st.done);
+        put_i64(f, s->st.last_finish);
+
+        for (int d = 0; d < s->st.done; d++){
+            int i = s->st.order[d];
+            put_i32(f, i);
+            put_i64(f, s->st.first_start[i]);
+            put_i64(f, s->st.finish[i]);
+        }
+
+        put_i32(f, s->st.rq.tail - s->st.rq.head);
+        for (int k2 = s->st.rq.head; k2 < s->st.rq.tail; k2++){
+            int i = s->st.rq.buf[k2];
+            put_i32(f, i);
+            put_i32(f, s->st.rem[i]);
+            put_i64(f, s->st.first_start[i]);
+        }
+    }
+
+    if (fclose(f) != 0 || rename(tmp, path) != 0){
+        remove(tmp);
+        return 0;
+    }
+    return 1;
+}
+
+//smallest on-disk size of a snapshot (key, time, done, last finish and queue length) and of one of its jobs
+#define CKPT_SNAP_MIN 44
+#define CKPT_JOB_MIN 16
+
+//read a checkpoint, returns the number of snapshots or 0 if the file is missing or damaged
+static int load_ckpt(const char *path, RRSnap **out){
+
+    *out = NULL;
+    FILE *f = fopen(path, "rb");
+    if (!f){
+        return 0;
+    }
+
+    //counts are checked against the bytes left in the file before anything is allocated for them,
+    //so a damaged header is ignored instead of asking for gigabytes
+    struct stat sb;
+    char magic[4];
+    int32_t version, count;
+    if (fstat(fileno(f), &sb) != 0 || fread(magic, 1, 4, f) != 4 || memcmp(magic, "RRCK", 4) != 0
+        || !get_i32(f, &version) || version != 2 || !get_i32(f, &count) || count < 0
+        || (int64_t)count > (sb.st_size - ftell(f)) / CKPT_SNAP_MIN){
+        fprintf(stderr, "ignoring damaged checkpoint %s\n", path);
+        fclose(f);
+        return 0;
+    }
+
+    RRSnap *snaps = calloc(count ? (size_t)count : 1, sizeof(RRSnap));
+    if (!snaps){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    int ok = 1;
+    int got = 0;
+    for (; got < count && ok; got++){
+        RRSnap *s = &snaps[got];
+        int32_t q, lat, n, done, qlen;
+        int64_t time, last;
+
+        ok = get_i32(f, &q) && get_i32(f, &lat) && get_i32(f, &n) && fread(&s->hash, sizeof(s->hash), 1, f) == 1
+            && get_i64(f, &time) && get_i32(f, &done) && get_i64(f, &last) && n > 0 && done >= 0 && done <= n
+            && (int64_t)n <= (sb.st_size - ftell(f) - 4) / CKPT_JOB_MIN;
+        if (!ok){
+            break;
+        }
+
+        s->quantum = q;
+        s->latency = lat;
+        s->n = (size_t)n;
+        rr_alloc(&s->st, s->n);
+        q_init(&s->st.rq, n - done);
+        s->st.time = time;
+        s->st.next_arr = s->n;
+        s->st.done = done;
+        s->st.last_finish = last;
+
+        //every job is either done or queued exactly once, a repeated index would leave another
+        //job's state uninitialized
+        char *seen = calloc((size_t)n, 1);
+        if (!seen){
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+
+        for (int d = 0; d < done && ok; d++){
+            int32_t i;
+            int64_t fs, fin;
+            ok = get_i32(f, &i) && get_i64(f, &fs) && get_i64(f, &fin) && i >= 0 && i < n && !seen[i];
+            if (ok){
+                seen[i] = 1;
+                s->st.order[d] = i;
+                s->st.rem[i] = 0;
+                s->st.first_start[i] = fs;
+                s->st.finish[i] = fin;
+            }
+        }
+
+        ok = ok && get_i32(f, &qlen) && qlen == n - done;
+        for (int k = 0; k < qlen && ok; k++){
+            int32_t i, r;
+            int64_t fs;
+            ok = get_i32(f, &i) && get_i32(f, &r) && get_i64(f, &fs) && i >= 0 && i < n && !seen[i] && r >= 0;
+            if (ok){
+                seen[i] = 1;
+                q_push(&s->st.rq, i);
+                s->st.rem[i] = r;
+                s->st.first_start[i] = fs;
+                s->st.finish[i] = -1;
+            }
+        }
+        free(seen);
+        s->valid = ok;
+    }
+    fclose(f);
+
+    if (!ok){
+        fprintf(stderr, "ignoring damaged checkpoint %s\n", path);
+        for (int k = 0; k < got; k++){
+            rr_free(&snaps[k].st);
+        }
+        free(snaps);
+        return 0;
+    }
+
+    *out = snaps;
+    return count;
+}
+
+//one sweep point handed to the cache
+typedef struct{
+    const Proc *p;
+    size_t n;
+    int quantum;
+    int latency;
+    const RROpts *o;
+} RRCell;
+
+static void rr_cell(void *ctx, FILE *f_details, FILE *f_summary){
+    const RRCell *rc = (const RRCell*)ctx;
+    simulate_rr(rc->p, rc->n, rc->quantum, rc->latency, f_details, f_summary, rc->o);
+}
+
+//run one sweep point, serving it from the cache directory when this trace and parameters were already simulated
+static void run_cell(const Proc *p, size_t n, uint64_t hash, const char *cache_dir, int quantum, int latency, FILE *f_details, FILE *f_summary,
+                     const RROpts *o){
+
+    //a timeline needs every slice and a checkpoint needs the end state, neither comes out of a cached
+    //point, so those are simulated again
+    if (!cache_dir || n == 0 || (o && (o->tl || o->save))){
+        simulate_rr(p, n, quantum, latency, f_details, f_summary, o);
+        return;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/rr-v%d-%016llx-q%d-l%d.%s", cache_dir, CACHE_VERSION, (unsigned long long)hash, quantum, latency,
+        col_out ? "raw" : "csv");
+
+    RRCell rc = { p, n, quantum, latency, o };
+    cache_cell(path, rr_cell, &rc, f_details, f_summary);
+}
+
+//read the header and every row of a trace, returns 0 after reporting a missing header or a bad row
+static int load_trace(FILE *in, const char *name, ProcList *pl){
+
     //read and ignore the first line
     char line[1024];
-    if (!fgets(line, sizeof(line), stdin)){
-        fprintf(stderr, "no input (expected header)\n");
-        return 1;
+    if (!fgets(line, sizeof(line), in)){
+        fprintf(stderr, "%s: no input (expected header)\n", name);
+        return 0;
     }
 
     //read every row from input
+    size_t line_no = 1;
+    while (fgets(line, sizeof(line), in)){
+
+        line_no++;
+
+        //skip blank lines
+        char *cur = line;
+        while (*cur == ' ' || *cur == '\t' || *cur == '\r' || *cur == '\n'){
+            cur++;
+        }
+        if (*cur == '\0'){
+            continue;
+        }
+
+        //rows have four fields and an optional priority column, traces without one run everything at level 0
+        int fields = 1;
+        for (const char *c = cur; *c; c++){
+            fields += *c == ',';
+        }
+
+        //read and assign values, anything that would not fit is rejected instead of wrapping
+        Proc pr;
+        pr.index = (int)pl->size;
+        if ((fields != 4 && fields != 5) || !parse_field(&cur, &pr.pid, 0) || !parse_field(&cur, &pr.arrival, 0)
+            || !parse_field(&cur, &pr.first_resp, 0) || !parse_field(&cur, &pr.burst, fields == 4) || pr.burst < 0){
+            fprintf(stderr, "%s:%zu: expected four comma separated integers that fit in 32 bits and an optional priority\n",
+                    name, line_no);
+            return 0;
+        }
+
+        pr.prio = 0;
+        if (fields == 5 && (!parse_field(&cur, &pr.prio, 1) || pr.prio < 0 || pr.prio >= PRIO_LEVELS)){
+            fprintf(stderr, "%s:%zu: priority must be an integer from 0 to %d\n", name, line_no, PRIO_LEVELS - 1);
+            return 0;
+        }
+
+        //add it to the queue
+        list_push(pl, pr);
+    }
+    return 1;
+}
+
+static void write_headers(FILE *f_details, FILE *f_summary){
+
+    //column files carry their names in the file header
+    if (col_out){
+        return;
+    }
+    fprintf(f_details, "Quantum_size,Pid,Arrival Time,Start Time,Finish Time,Turnaround Time,Waiting Time,Response Time\n");
+    fprintf(f_summary, "Quantum_size,Throughput,Avg_Waiting_Time,Avg_Turnaround_Time,Avg_Response_Time\n");
+}
+
+//batch and ensemble glue: the sweep every trace goes through
+typedef struct{
+    const char *cache_dir;
+    int q_lo;
+    int q_hi;
+    int latency;
+} SweepCtx;
+
+static int load_procs(FILE *in, const char *path, void **jobs, size_t *n){
 
-    //create list
     ProcList pl;
     list_init(&pl);
+    int ok = load_trace(in, path, &pl);
+    *jobs = pl.data;
+    *n = pl.size;
+    return ok;
+}
 
-    while (fgets(line, sizeof(line), stdin)){
+//every trace of a batch gets its characterization and meta file next to it
+static void batch_prepare(void *ctx, const char *path, const void *jobs, size_t n, void *extra){
 
-        //create variables to assign input values to
-        int pid;
-        int arr;
-        int first_resp;
-        int burst;
+    const SweepCtx *sw = (const SweepCtx*)ctx;
+    TraceStats *ts = (TraceStats*)extra;
+    trace_stats((const Proc*)jobs, n, ts);
 
-        //read and assign values
-        sscanf(line, " %d , %d , %d , %d ", &pid, &arr, &first_resp, &burst);
+    char *meta = out_path(path, "rr_results_meta.csv");
+    write_meta(meta, ts, sw->q_lo, sw->q_hi, 1, 1);
+    free(meta);
+}
 
-        //create process and assign values
-        Proc pr;
-        pr.pid = pid;
-        pr.arrival = arr;
-        pr.first_resp = first_resp;
-        pr.burst = burst;
+static int batch_open(void *ctx, const char *details, const char *summary, FILE **f_details, FILE **f_summary){
 
-        //add it to the queue
-        list_push(&pl, pr);
+    const SweepCtx *sw = (const SweepCtx*)ctx;
+    if (!open_outputs(details, summary, sw->q_lo, sw->q_hi, sw->latency, f_details, f_summary)){
+        return 0;
+    }
+    write_headers(*f_details, *f_summary);
+    return 1;
+}
+
+static void batch_point(void *ctx, const void *jobs, size_t n, uint64_t hash, const void *extra, int cell,
+                        FILE *f_details, FILE *f_summary){
+
+    const SweepCtx *sw = (const SweepCtx*)ctx;
+    RROpts o;
+    memset(&o, 0, sizeof(o));
+    o.ts = (const TraceStats*)extra;
+    run_cell((const Proc*)jobs, n, hash, sw->cache_dir, sw->q_lo + cell, sw->latency, f_details, f_summary, &o);
+}
+
+static int run_batch(char **paths, int ntraces, int q_lo, int q_hi, int latency, const char *cache_dir, int nworkers){
+
+    SweepCtx sw = { cache_dir, q_lo, q_hi, latency };
+    BatchJob job = { "RR", sizeof(Proc), cmp_proc, load_procs, sizeof(TraceStats), batch_prepare,
+        col_out ? "rr_results_details.col" : "rr_results_details.csv", col_out ? "rr_results.col" : "rr_results.csv",
+        batch_open, batch_point, &sw, q_hi - q_lo + 1 };
+    return batch_run(&job, paths, ntraces, nworkers);
+}
+
+//a variant is swept in ascending quantum order, so each pool worker keeps a prefix fork in its state
+static void ensemble_point(void *ctx, void *worker, const void *jobs, size_t n, double *metrics){
+
+    const SweepCtx *sw = (const SweepCtx*)ctx;
+    RRSnap *fork = (RRSnap*)worker;
+    const Proc *p = (const Proc*)jobs;
+
+    TraceStats ts;
+    trace_stats(p, n, &ts);
+
+    //the fork left behind belongs to the previous variant's trace
+    if (fork->valid){
+        rr_free(&fork->st);
+        fork->valid = 0;
+    }
+
+    RROpts o;
+    memset(&o, 0, sizeof(o));
+    o.fork = fork;
+    o.ts = &ts;
+    for (int q = sw->q_lo; q <= sw->q_hi; q++){
+        o.metrics = &metrics[(size_t)(q - sw->q_lo) * ENS_METRICS];
+        simulate_rr(p, n, q, sw->latency, NULL, NULL, &o);
+    }
+}
+
+static void ensemble_free(void *worker){
+
+    RRSnap *fork = (RRSnap*)worker;
+    if (fork->valid){
+        rr_free(&fork->st);
+    }
+}
+
+static int run_ensemble(const Proc *p, size_t n, int k, int jitter, double scale, uint64_t seed, int q_lo, int q_hi,
+                        int latency, int nworkers, const char *path){
+
+    SweepCtx sw = { NULL, q_lo, q_hi, latency };
+    EnsJob e = { "RR", p, n, sizeof(Proc), cmp_proc, k, jitter, scale, seed, q_lo, q_hi - q_lo + 1, summary_names,
+        sizeof(RRSnap), ensemble_point, ensemble_free, &sw };
+    return ens_run(&e, nworkers, path);
+}
+
+//sharded sweep (-w N): the segment holds this header and then the sorted trace
+typedef struct{
+    size_t n;
+    uint64_t hash;
+    TraceStats ts;
+} ShmTrace;
+
+typedef struct{
+    const char *cache_dir;
+    int q_lo;
+    int latency;
+    //points arrive at a worker in ascending quantum order, so each worker keeps its own prefix fork here
+    RRSnap fork;
+} ShardCtx;
+
+static void shard_cell(void *ctx, const void *seg, int cell, FILE *f_details, FILE *f_summary){
+
+    ShardCtx *sc = (ShardCtx*)ctx;
+    const ShmTrace *hdr = (const ShmTrace*)seg;
+    const Proc *p = (const Proc*)(hdr + 1);
+
+    RROpts o;
+    memset(&o, 0, sizeof(o));
+    o.fork = &sc->fork;
+    o.ts = &hdr->ts;
+    run_cell(p, hdr->n, hdr->hash, sc->cache_dir, sc->q_lo + cell, sc->latency, f_details, f_summary, &o);
+}
+
+static int run_sharded(const Proc *p, size_t n, uint64_t hash, const TraceStats *ts, const char *cache_dir, int q_lo,
+                       int q_hi, int latency, int nprocs, FILE *f_details, FILE *f_summary){
+
+    ShmTrace hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.n = n;
+    hdr.hash = hash;
+    hdr.ts = *ts;
+
+    ShardCtx sc;
+    memset(&sc, 0, sizeof(sc));
+    sc.cache_dir = cache_dir;
+    sc.q_lo = q_lo;
+    sc.latency = latency;
+
+    ShardJob job = { "a2p2", &hdr, sizeof(hdr), p, sizeof(Proc) * n, q_hi - q_lo + 1, shard_cell, &sc, "quantum", q_lo };
+    return shard_run(&job, nprocs, f_details, f_summary);
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-q MIN:MAX] [-L latency] [-c cache_dir] [-k checkpoint] [-t timeline] [-C] < trace.csv\n", prog);
+    fprintf(stderr, "       %s -w procs [-q MIN:MAX] [-L latency] [-c cache_dir] [-C] < trace.csv\n", prog);
+    fprintf(stderr, "       %s -b [-j threads] [-q MIN:MAX] [-L latency] [-c cache_dir] [-C] trace.csv...\n", prog);
+    fprintf(stderr, "       %s -e variants [-J jitter] [-S scale] [-s seed] [-j threads] [-q MIN:MAX] [-L latency] < trace.csv\n", prog);
+    fprintf(stderr, "       %s -p [-a MIN:MAX] [-L latency] < trace.csv\n", prog);
+}
+
+int main(int argc, char **argv){
+
+    //quantum sweep range, dispatcher latency and optional result cache
+    int q_lo = 1, q_hi = 200;
+    int latency = 20;
+    const char *cache_dir = NULL;
+    const char *ckpt_path = NULL;
+    const char *tl_path = NULL;
+    //batch mode takes trace files as arguments instead of stdin
+    int batch = 0;
+    int nworkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    //sharded mode splits the sweep over this many worker processes
+    int nprocs = 0;
+    //ensemble mode: variant count and how each variant is perturbed
+    int ens_k = 0;
+    int jitter = 0;
+    double scale = 0.0;
+    uint64_t seed = 1;
+    //priority policy, swept over the aging interval instead of the quantum
+    int prio = 0;
+    int a_lo = 1, a_hi = 200;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "q:L:c:k:t:bj:w:e:J:S:s:pa:C")) != -1){
+        switch (opt){
+            case 'q':
+                if (!parse_range(optarg, 1, &q_lo, &q_hi)){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'L':
+                latency = atoi(optarg);
+                if (latency < 0){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'c':
+                cache_dir = optarg;
+                break;
+            case 'k':
+                ckpt_path = optarg;
+                break;
+            case 't':
+                tl_path = optarg;
+                break;
+            case 'b':
+                batch = 1;
+                break;
+            case 'j':
+                nworkers = atoi(optarg);
+                break;
+            case 'w':
+                nprocs = atoi(optarg);
+                if (nprocs < 1){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'e':
+                ens_k = atoi(optarg);
+                if (ens_k < 1){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'J':
+                jitter = atoi(optarg);
+                if (jitter < 0){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'S':
+                scale = atof(optarg);
+                if (scale < 0.0 || scale > 1.0){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'p':
+                prio = 1;
+                break;
+            case 'a':
+                if (!parse_range(optarg, 1, &a_lo, &a_hi)){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'C':
+                col_out = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (cache_dir && mkdir(cache_dir, 0777) != 0 && errno != EEXIST){
+        fprintf(stderr, "cannot create cache directory %s\n", cache_dir);
+        return 1;
+    }
+
+    //workers do not share checkpoint or timeline state, so those stay single process
+    if (nprocs && (batch || ckpt_path || tl_path)){
+        usage(argv[0]);
+        return 1;
+    }
+    //an ensemble only produces the banded summary, the per run outputs and caches do not apply
+    if (ens_k && (batch || nprocs || ckpt_path || tl_path || cache_dir || col_out)){
+        usage(argv[0]);
+        return 1;
+    }
+    if (prio && (batch || nprocs || ens_k || ckpt_path || tl_path || cache_dir || col_out)){
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (batch){
+        if (optind == argc || ckpt_path || tl_path){
+            usage(argv[0]);
+            return 1;
+        }
+        return run_batch(argv + optind, argc - optind, q_lo, q_hi, latency, cache_dir, nworkers);
+    }
+
+    //create list
+    ProcList pl;
+    list_init(&pl);
+
+    if (!load_trace(stdin, "stdin", &pl)){
+        free(pl.data);
+        return 1;
     }
 
     // Sort by arrival then PID
     qsort(pl.data, pl.size, sizeof(Proc), cmp_proc);
 
-    // Open outputs to write to
-    FILE *f_details = fopen("rr_results_details.csv", "w");
-    FILE *f_summary = fopen("rr_results.csv", "w");
+    if (prio){
+        int rc = run_prio(pl.data, pl.size, a_lo, a_hi, latency);
+        free(pl.data);
+        return rc;
+    }
 
+    if (ens_k){
+        int rc = run_ensemble(pl.data, pl.size, ens_k, jitter, scale, seed, q_lo, q_hi, latency, nworkers, "rr_results.csv");
+        free(pl.data);
+        return rc;
+    }
+
+    // Open outputs to write to
+    const char *details_path = col_out ? "rr_results_details.col" : "rr_results_details.csv";
+    const char *summary_path = col_out ? "rr_results.col" : "rr_results.csv";
+    FILE *f_details, *f_summary;
+    if (!open_outputs(details_path, summary_path, q_lo, q_hi, latency, &f_details, &f_summary)){
+        fprintf(stderr, "cannot open %s or %s for write\n", details_path, summary_path);
+        free(pl.data);
+        return 1;
+    }
 
     //output headers
-    fprintf(f_details, "Quantum_size,Pid,Arrival Time,Start Time,Finish Time,Turnaround Time,Waiting Time,Response Time\n");
-    fprintf(f_summary, "Quantum_size,Throughput,Avg_Waiting_Time,Avg_Turnaround_Time,Avg_Response_Time\n");
+    write_headers(f_details, f_summary);
 
-    // Assignment Part II: sweep quantum 1..200, latency fixed at 20
-    const int latency = 20;
-    for (int q = 1; q <= 200; q++) {
-        simulate_rr(pl.data, pl.size, q, latency, f_details, f_summary);
+    // Assignment Part II: sweep quantum 1..200, latency fixed at 20 unless overridden
+    uint64_t hash = trace_hash(pl.data, pl.size, sizeof(Proc));
+
+    //characterize the trace once, every sweep point picks its engine from these stats
+    TraceStats ts;
+    trace_stats(pl.data, pl.size, &ts);
+    write_meta("rr_results_meta.csv", &ts, q_lo, q_hi, ckpt_path == NULL, tl_path == NULL);
+
+    if (nprocs){
+        int rc = run_sharded(pl.data, pl.size, hash, &ts, cache_dir, q_lo, q_hi, latency, nprocs, f_details, f_summary);
+        if (rc == 0){
+            printf("RR simulation completed! Results saved to %s\n", summary_path);
+            printf("Average results saved to %s\n", details_path);
+        }
+        fclose(f_details);
+        fclose(f_summary);
+        free(pl.data);
+        return rc;
+    }
+
+    //with a checkpoint, each sweep point resumes from its snapshot when the trace only grew at the end
+    RRSnap *old = NULL;
+    int n_old = 0;
+    RRSnap *fresh = NULL;
+    int resumed = 0;
+    Timeline *tl = tl_path ? tl_open(tl_path) : NULL;
+    //shared prefix handed from each quantum to the next, a timeline needs every slice so it goes without
+    RRSnap fork;
+    memset(&fork, 0, sizeof(fork));
+
+    if (ckpt_path){
+        n_old = load_ckpt(ckpt_path, &old);
+        fresh = calloc((size_t)(q_hi - q_lo + 1), sizeof(RRSnap));
+        if (!fresh){
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+
+    for (int q = q_lo; q <= q_hi; q++) {
+        const RRSnap *from = NULL;
+        for (int k = 0; k < n_old; k++){
+            if (old[k].quantum == q && old[k].latency == latency){
+                from = &old[k];
+            }
+        }
+        //resuming would skip the slices before the snapshot, so a timeline run always starts at zero
+        if (tl){
+            from = NULL;
+        }
+        resumed += snap_usable(from, pl.data, pl.size, q, latency);
+
+        RROpts o;
+        o.from = from;
+        o.save = fresh ? &fresh[q - q_lo] : NULL;
+        o.fork = tl ? NULL : &fork;
+        o.tl = tl;
+        o.ts = &ts;
+        o.metrics = NULL;
+        run_cell(pl.data, pl.size, hash, cache_dir, q, latency, f_details, f_summary, &o);
+    }
+
+    if (tl){
+        tl_close(tl);
+    }
+    if (fork.valid){
+        rr_free(&fork.st);
+    }
+
+    if (ckpt_path){
+        //new snapshots replace old ones, old ones for points not simulated this time are carried over
+        int total = q_hi - q_lo + 1;
+        RRSnap *all = malloc(sizeof(RRSnap) * (size_t)(total + n_old));
+        if (!all){
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        int count = 0;
+        for (int k = 0; k < total; k++){
+            if (fresh[k].valid){
+                all[count++] = fresh[k];
+            }
+        }
+        for (int k = 0; k < n_old; k++){
+            int replaced = 0;
+            for (int j = 0; j < total; j++){
+                replaced |= fresh[j].valid && fresh[j].quantum == old[k].quantum && fresh[j].latency == old[k].latency;
+            }
+            if (!replaced){
+                all[count++] = old[k];
+            }
+        }
+
+        if (!save_ckpt(ckpt_path, all, count)){
+            fprintf(stderr, "cannot write checkpoint %s\n", ckpt_path);
+        }
+        printf("Resumed %d of %d sweep points from %s\n", resumed, total, ckpt_path);
+
+        for (int k = 0; k < total; k++){
+            if (fresh[k].valid){
+                rr_free(&fresh[k].st);
+            }
+        }
+        for (int k = 0; k < n_old; k++){
+            rr_free(&old[k].st);
+        }
+        free(all);
+        free(fresh);
+        free(old);
     }
 
-    printf("RR simulation completed! Results saved to rr_results.csv\n");
-    printf("Average results saved to rr_results_details.csv\n");
+    printf("RR simulation completed! Results saved to %s\n", summary_path);
+    printf("Average results saved to %s\n", details_path);
 
     fclose(f_details);
     fclose(f_summary);
@@ -0,0 +1,148 @@
+//coldump: print a -C column file from a2p1 or a2p2 back out as csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define COL_MAX 8
+
+//bounds checked cursor over the mapped file
+typedef struct{
+    const unsigned char *base;
+    size_t len;
+    size_t pos;
+} Cursor;
+
+static const void *take(Cursor *c, size_t n){
+
+    if (n > c->len - c->pos){
+        fprintf(stderr, "truncated column file\n");
+        exit(1);
+    }
+    const void *p = c->base + c->pos;
+    c->pos += n;
+    return p;
+}
+
+//column files are little-endian, assemble width bytes lowest first so any host reads them the same
+static uint64_t le(const unsigned char *p, int width){
+    uint64_t v = 0;
+    for (int k = width - 1; k >= 0; k--){
+        v = (v << 8) | p[k];
+    }
+    return v;
+}
+
+static uint32_t take_u32(Cursor *c){
+    return (uint32_t)le(take(c, 4), 4);
+}
+
+static int64_t take_i64(Cursor *c){
+    return (int64_t)le(take(c, 8), 8);
+}
+
+static void align8(Cursor *c){
+    c->pos = (c->pos + 7) & ~(size_t)7;
+}
+
+int main(int argc, char **argv){
+
+    if (argc != 2){
+        fprintf(stderr, "usage: %s results.col\n", argv[0]);
+        return 1;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) != 0){
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+    if (sb.st_size == 0){
+        fprintf(stderr, "%s is empty\n", argv[1]);
+        return 1;
+    }
+
+    const unsigned char *map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED){
+        fprintf(stderr, "cannot map %s\n", argv[1]);
+        return 1;
+    }
+
+    Cursor c = { map, (size_t)sb.st_size, 0 };
+
+    uint32_t version = 0;
+    if (memcmp(take(&c, 4), "SCOL", 4) != 0 || ((version = take_u32(&c)) != 1 && version != 2)){
+        fprintf(stderr, "%s is not a column file\n", argv[1]);
+        return 1;
+    }
+
+    //sweep description goes to stderr so stdout stays plain csv. version 1 did not pad the name
+    uint32_t plen = take_u32(&c);
+    const char *param = take(&c, plen);
+    if (version >= 2){
+        align8(&c);
+    }
+    int64_t lo = take_i64(&c), hi = take_i64(&c), fixed = take_i64(&c);
+    fprintf(stderr, "%.*s %lld..%lld, fixed %lld\n", (int)plen, param, (long long)lo, (long long)hi, (long long)fixed);
+
+    uint32_t ncols = take_u32(&c);
+    if (ncols == 0 || ncols > COL_MAX){
+        fprintf(stderr, "bad column count %u\n", ncols);
+        return 1;
+    }
+
+    char types[COL_MAX];
+    for (uint32_t k = 0; k < ncols; k++){
+        types[k] = *(const char*)take(&c, 1);
+        uint32_t nlen = take_u32(&c);
+        printf("%s%.*s", k ? "," : "", (int)nlen, (const char*)take(&c, nlen));
+    }
+    printf("\n");
+    align8(&c);
+
+    //each block: locate every column in place, then walk the rows across them
+    while (c.pos < c.len){
+        uint32_t rows = take_u32(&c);
+        take_u32(&c);
+
+        int width[COL_MAX];
+        int64_t minv[COL_MAX];
+        const unsigned char *data[COL_MAX];
+
+        for (uint32_t k = 0; k < ncols; k++){
+            width[k] = *(const unsigned char*)take(&c, 8);
+            minv[k] = take_i64(&c);
+            take_i64(&c);
+            data[k] = take(&c, (size_t)rows * width[k]);
+            align8(&c);
+        }
+
+        for (uint32_t r = 0; r < rows; r++){
+            for (uint32_t k = 0; k < ncols; k++){
+                uint64_t raw = le(data[k] + (size_t)r * width[k], width[k]);
+
+                //same precision as the csv writers, throughput keeps six decimals and averages two
+                if (types[k] == 'f' || types[k] == 'd'){
+                    double d;
+                    memcpy(&d, &raw, 8);
+                    printf(types[k] == 'f' ? "%s%.6f" : "%s%.2f", k ? "," : "", d);
+                }
+                else{
+                    int64_t v = width[k] == 8 ? (int64_t)raw : minv[k] + (int64_t)raw;
+                    printf("%s%lld", k ? "," : "", (long long)v);
+                }
+            }
+            printf("\n");
+        }
+    }
+
+    munmap((void*)map, (size_t)sb.st_size);
+    return 0;
+}
@@ -0,0 +1,143 @@
+//rrtimeline: print the slices of an a2p2 -t timeline that overlap a time window
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+//index entry, same layout the writer in a2p2.c uses
+typedef struct{
+    int64_t quantum;
+    int64_t first;
+    int64_t last_end;
+    uint64_t offset;
+} TLIndex;
+
+//read one varint, returns 0 at end of input
+static int get_varint(FILE *f, uint64_t *v){
+
+    uint64_t x = 0;
+    int shift = 0;
+    int c;
+
+    while ((c = fgetc(f)) != EOF){
+        x |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)){
+            *v = x;
+            return 1;
+        }
+        shift += 7;
+        if (shift > 63){
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static int64_t unzigzag(uint64_t v){
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-q quantum] [-f from] [-t to] timeline.bin\n", prog);
+}
+
+int main(int argc, char **argv){
+
+    //window is inclusive, a slice is printed if any part of it falls inside
+    long long from = INT64_MIN;
+    long long to = INT64_MAX;
+    long long want_q = -1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "q:f:t:")) != -1){
+        switch (opt){
+            case 'q':
+                want_q = atoll(optarg);
+                break;
+            case 'f':
+                from = atoll(optarg);
+                break;
+            case 't':
+                to = atoll(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1){
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[optind], "rb");
+    if (!f){
+        fprintf(stderr, "cannot open %s\n", argv[optind]);
+        return 1;
+    }
+
+    //footer: index offset then "RRTE"
+    char magic[5];
+    uint64_t index_off, nidx;
+    if (fread(magic, 1, 5, f) != 5 || memcmp(magic, "RRTL\1", 5) != 0 || fseek(f, -12, SEEK_END) != 0
+        || fread(&index_off, sizeof(index_off), 1, f) != 1 || fread(magic, 1, 4, f) != 4 || memcmp(magic, "RRTE", 4) != 0
+        || fseek(f, (long)index_off, SEEK_SET) != 0 || fread(&nidx, sizeof(nidx), 1, f) != 1){
+        fprintf(stderr, "%s is not a complete timeline\n", argv[optind]);
+        fclose(f);
+        return 1;
+    }
+
+    TLIndex *idx = malloc(sizeof(TLIndex) * (nidx ? nidx : 1));
+    if (!idx || fread(idx, sizeof(TLIndex), nidx, f) != nidx){
+        fprintf(stderr, "%s has a damaged index\n", argv[optind]);
+        fclose(f);
+        free(idx);
+        return 1;
+    }
+
+    printf("Quantum_size,Pid,Dispatch Time,Start Time,Run Length,Latency\n");
+
+    //only blocks whose time range meets the window are decoded
+    for (uint64_t b = 0; b < nidx; b++){
+        if ((want_q >= 0 && idx[b].quantum != want_q) || idx[b].first > to || idx[b].last_end < from){
+            continue;
+        }
+
+        fseek(f, (long)idx[b].offset, SEEK_SET);
+
+        uint64_t q, lat, count, first;
+        if (!get_varint(f, &q) || !get_varint(f, &lat) || !get_varint(f, &count) || !get_varint(f, &first)){
+            fprintf(stderr, "damaged block at offset %llu\n", (unsigned long long)idx[b].offset);
+            break;
+        }
+
+        int64_t pid = 0;
+        int64_t prev_end = unzigzag(first);
+
+        for (uint64_t k = 0; k < count; k++){
+            uint64_t dpid, gap, run;
+            if (!get_varint(f, &dpid) || !get_varint(f, &gap) || !get_varint(f, &run)){
+                fprintf(stderr, "damaged block at offset %llu\n", (unsigned long long)idx[b].offset);
+                break;
+            }
+
+            pid += unzigzag(dpid);
+            int64_t dispatch = prev_end + (int64_t)gap;
+            prev_end = dispatch + (int64_t)lat + (int64_t)run;
+
+            if (dispatch > to){
+                break;
+            }
+            if (prev_end >= from){
+                printf("%llu,%lld,%lld,%lld,%llu,%llu\n", (unsigned long long)q, (long long)pid, (long long)dispatch,
+                    (long long)(dispatch + (int64_t)lat), (unsigned long long)run, (unsigned long long)lat);
+            }
+        }
+    }
+
+    fclose(f);
+    free(idx);
+    return 0;
+}
@@ -0,0 +1,1300 @@
+//sweep.h: the parts of a sweep that do not depend on the scheduling policy, shared by a2p1 and a2p2.
+//column output, the result cache, trace field parsing and hashing, the work-stealing pool, in order
+//output of sweep points finished out of order, and the batch, ensemble and sharded drivers. the policy
+//is plugged in through callbacks. each simulator includes it once, after defining _GNU_SOURCE
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <time.h>
+
+//columnar output (-C): the simulators write fixed-width host order records instead of csv text,
+//8 bytes per field, and the output FILE is a column writer that regroups them into blocks.
+//the file itself is little-endian whatever the host, every integer and float is encoded byte by byte.
+//file: "SCOL", version 2, sweep parameter name padded to 8 bytes, lo/hi, the fixed other parameter,
+//column count, then per column a type and name. types are 'i' int64, 'f' float64 shown with six
+//decimals and 'd' float64 shown with two, the precision the csv writers use. each block is the row
+//count, then per column its byte width, min and max, then the column values. integer columns are stored
+//as offsets from the block min in the smallest width that fits (0, 1, 2, 4 or 8 bytes).
+//the int64 header fields and everything in a block are 8 byte aligned, so readers can mmap the file
+//and use them in place. only the column names in the header have to be read byte by byte
+static int col_out = 0;
+
+#define COL_BLOCK 65536
+#define COL_MAX 8
+
+typedef struct{
+    FILE *f;
+    int ncols;
+    const char *types;
+    //partial record carried between writes
+    unsigned char rec[COL_MAX * 8];
+    size_t rec_len;
+    int64_t *cols[COL_MAX];
+    size_t rows;
+} ColWriter;
+
+//write the low width bytes of v, lowest first
+static void col_put_le(FILE *f, uint64_t v, int width){
+    unsigned char b[8];
+    for (int k = 0; k < width; k++){
+        b[k] = (unsigned char)(v >> (8 * k));
+    }
+    fwrite(b, 1, (size_t)width, f);
+}
+
+static void col_put_u32(FILE *f, uint32_t v){
+    col_put_le(f, v, 4);
+}
+
+static void col_put_i64(FILE *f, int64_t v){
+    col_put_le(f, (uint64_t)v, 8);
+}
+
+static void col_put_str(FILE *f, const char *s){
+    col_put_u32(f, (uint32_t)strlen(s));
+    fwrite(s, 1, strlen(s), f);
+}
+
+static void col_pad(FILE *f, size_t len){
+    static const unsigned char zero[8];
+    fwrite(zero, 1, (8 - len % 8) % 8, f);
+}
+
+static void col_flush(ColWriter *w){
+
+    if (w->rows == 0){
+        return;
+    }
+
+    col_put_u32(w->f, (uint32_t)w->rows);
+    col_put_u32(w->f, 0);
+
+    for (int c = 0; c < w->ncols; c++){
+        int64_t *v = w->cols[c];
+        unsigned char width = 8;
+        int64_t lo = v[0], hi = v[0];
+
+        if (w->types[c] == 'i'){
+            for (size_t r = 1; r < w->rows; r++){
+                lo = v[r] < lo ? v[r] : lo;
+                hi = v[r] > hi ? v[r] : hi;
+            }
+            uint64_t span = (uint64_t)hi - (uint64_t)lo;
+            width = span == 0 ? 0 : span <= 0xff ? 1 : span <= 0xffff ? 2 : span <= 0xffffffffULL ? 4 : 8;
+        } 
+        else{
+            double dlo, dhi, d;
+            memcpy(&dlo, &v[0], 8);
+            dhi = dlo;
+            for (size_t r = 1; r < w->rows; r++){
+                memcpy(&d, &v[r], 8);
+                dlo = d < dlo ? d : dlo;
+                dhi = d > dhi ? d : dhi;
+            }
+            memcpy(&lo, &dlo, 8);
+            memcpy(&hi, &dhi, 8);
+        }
+
+        unsigned char hdr[8] = { width };
+        fwrite(hdr, 1, 8, w->f);
+        col_put_i64(w->f, lo);
+        col_put_i64(w->f, hi);
+
+        //8 byte columns hold the values themselves (float bits included), narrower ones
+        //offsets from the block min that fit the chosen width
+        for (size_t r = 0; r < w->rows; r++){
+            uint64_t off = width == 8 ? (uint64_t)v[r] : (uint64_t)v[r] - (uint64_t)lo;
+            col_put_le(w->f, off, width);
+        }
+        col_pad(w->f, w->rows * width);
+    }
+
+    w->rows = 0;
+}
+
+static ssize_t col_write(void *cookie, const char *buf, size_t size){
+
+    ColWriter *w = (ColWriter*)cookie;
+    size_t rec_size = (size_t)w->ncols * 8;
+
+    for (size_t k = 0; k < size; ){
+        size_t take = rec_size - w->rec_len;
+        if (take > size - k){
+            take = size - k;
+        }
+        memcpy(w->rec + w->rec_len, buf + k, take);
+        w->rec_len += take;
+        k += take;
+
+        if (w->rec_len == rec_size){
+            for (int c = 0; c < w->ncols; c++){
+                memcpy(&w->cols[c][w->rows], w->rec + c * 8, 8);
+            }
+            w->rec_len = 0;
+            if (++w->rows == COL_BLOCK){
+                col_flush(w);
+            }
+        }
+    }
+    return (ssize_t)size;
+}
+
+static int col_close(void *cookie){
+
+    ColWriter *w = (ColWriter*)cookie;
+    col_flush(w);
+
+    int rc = fclose(w->f);
+    for (int c = 0; c < w->ncols; c++){
+        free(w->cols[c]);
+    }
+    free(w);
+    return rc;
+}
+
+//open a column writer behind a FILE, so the rest of the program writes records to it like any output
+static FILE *col_open(const char *path, const char *param, int lo, int hi, int fixed,
+                      int ncols, const char *types, const char *const *names){
+
+    ColWriter *w = calloc(1, sizeof(ColWriter));
+    if (!w){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    w->f = fopen(path, "wb");
+    if (!w->f){
+        free(w);
+        return NULL;
+    }
+    w->ncols = ncols;
+    w->types = types;
+    for (int c = 0; c < ncols; c++){
+        w->cols[c] = malloc(sizeof(int64_t) * COL_BLOCK);
+        if (!w->cols[c]){
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    fwrite("SCOL", 1, 4, w->f);
+    col_put_u32(w->f, 2);
+    col_put_str(w->f, param);
+    col_pad(w->f, 12 + strlen(param));
+    col_put_i64(w->f, lo);
+    col_put_i64(w->f, hi);
+    col_put_i64(w->f, fixed);
+    col_put_u32(w->f, (uint32_t)ncols);
+    for (int c = 0; c < ncols; c++){
+        fputc(types[c], w->f);
+        col_put_str(w->f, names[c]);
+    }
+
+    //header is variable length, pad so the first block starts aligned
+    long len = ftell(w->f);
+    col_pad(w->f, (size_t)len);
+
+    cookie_io_functions_t io = { NULL, col_write, NULL, col_close };
+    FILE *f = fopencookie(w, "w", io);
+    if (!f){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return f;
+}
+
+
+//copy a cache entry to the outputs, every line but the last is details and the last is the summary row.
+//columnar runs cache raw records instead, where the summary is the last 40 bytes
+static int cache_copy(const char *path, FILE *f_details, FILE *f_summary){
+
+    FILE *fc = fopen(path, "rb");
+    if (!fc){
+        return 0;
+    }
+
+    fseek(fc, 0, SEEK_END);
+    long len = ftell(fc);
+    fseek(fc, 0, SEEK_SET);
+
+    char *buf = malloc(len > 0 ? (size_t)len : 1);
+    if (!buf){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    size_t got = fread(buf, 1, (size_t)len, fc);
+    fclose(fc);
+
+    //an entry that is empty or cut short is treated as a miss
+    int complete = col_out ? len >= 40 && (len - 40) % 64 == 0 : len > 0 && buf[len - 1] == '\n';
+    if (got != (size_t)len || !complete){
+        free(buf);
+        return 0;
+    }
+
+    long last = len - 1;
+    if (col_out){
+        last = len - 40;
+    }
+    while (!col_out && last > 0 && buf[last - 1] != '\n'){
+        last--;
+    }
+
+    fwrite(buf, 1, (size_t)last, f_details);
+    fwrite(buf + last, 1, (size_t)(len - last), f_summary);
+    free(buf);
+    return 1;
+}
+
+//simulate one sweep point into the outputs
+typedef void (*CellFn)(void *ctx, FILE *f_details, FILE *f_summary);
+
+//serve one sweep point from the cache entry at path, on a miss simulate it with fn and store the entry
+static void cache_cell(const char *path, CellFn fn, void *ctx, FILE *f_details, FILE *f_summary){
+
+    if (cache_copy(path, f_details, f_summary)){
+        return;
+    }
+
+    //miss: simulate into a temp file and rename it, so an interrupted run never leaves a partial entry
+    //batch workers can miss on the same entry at once, so the temp name is unique per call too
+    static unsigned long tmp_seq;
+    char tmp[4200];
+    snprintf(tmp, sizeof(tmp), "%s.%ld.%lu.tmp", path, (long)getpid(), __sync_fetch_and_add(&tmp_seq, 1));
+
+    FILE *fc = fopen(tmp, "w");
+    if (!fc){
+        fprintf(stderr, "cannot write cache entry %s\n", tmp);
+        fn(ctx, f_details, f_summary);
+        return;
+    }
+
+    fn(ctx, fc, fc);
+
+    if (fclose(fc) != 0 || rename(tmp, path) != 0 || !cache_copy(path, f_details, f_summary)){
+        fprintf(stderr, "cannot store cache entry %s\n", path);
+        remove(tmp);
+        fn(ctx, f_details, f_summary);
+    }
+}
+
+//parse "MIN:MAX" or a single value into an inclusive range, neither end may be below min
+static int parse_range(const char *s, int min, int *lo, int *hi){
+
+    char *end;
+    long a = strtol(s, &end, 10);
+    long b = a;
+
+    if (*end == ':'){
+        b = strtol(end + 1, &end, 10);
+    }
+    if (*end != '\0' || a < min || b < a || b > 1000000){
+        return 0;
+    }
+    *lo = (int)a;
+    *hi = (int)b;
+    return 1;
+}
+
+//parse one integer field of a trace row, it has to fit in the 32 bit fields of a row. every field but
+//the last of a row must be followed by a comma, and after the last only whitespace may be left
+static int parse_field(char **cur, int *out, int last){
+
+    char *end;
+    errno = 0;
+    long long v = strtoll(*cur, &end, 10);
+
+    if (end == *cur || errno == ERANGE || v < INT_MIN || v > INT_MAX){
+        return 0;
+    }
+    while (*end == ' ' || *end == '\t'){
+        end++;
+    }
+    if (!last && *end != ','){
+        return 0;
+    }
+    if (!last){
+        end++;
+    }
+    while (last && (*end == '\r' || *end == '\n')){
+        end++;
+    }
+    if (last && *end != '\0'){
+        return 0;
+    }
+
+    *cur = end;
+    *out = (int)v;
+    return 1;
+}
+
+//every job struct of a simulator starts with these fields in this order, so the hash, the batch loader
+//and the ensemble resampler handle either simulator's jobs knowing only their size
+typedef struct{
+    int pid;
+    int arrival;
+    int first_resp;
+    int burst;
+    //position in the trace or variant, the last sort tie-break
+    int index;
+} JobHead;
+
+//FNV-1a hash of the sorted trace, used to key cache entries to the exact job set
+static uint64_t trace_hash(const void *jobs, size_t n, size_t size){
+
+    uint64_t h = 1469598103934665603ULL;
+
+    for (size_t i = 0; i < n; i++){
+        JobHead j;
+        memcpy(&j, (const char*)jobs + i * size, sizeof(j));
+        int v[4] = { j.pid, j.arrival, j.first_resp, j.burst };
+        const unsigned char *b = (const unsigned char*)v;
+
+        for (size_t k = 0; k < sizeof(v); k++){
+            h ^= b[k];
+            h *= 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+//work-stealing pool: every worker owns a deque of task ids, pops its own from the front
+//and steals from the back of another worker's deque once its own runs dry
+typedef struct{
+    pthread_mutex_t mu;
+    int *ids;
+    int head;
+    int tail;
+} WSDeque;
+
+typedef struct{
+    WSDeque *dq;
+    int nworkers;
+    void (*fn)(void *ctx, int task);
+    void *ctx;
+} WSPool;
+
+typedef struct{
+    WSPool *pool;
+    int self;
+} WSWorker;
+
+//index of the pool worker running the current task, for tasks that keep per worker scratch
+static __thread int pool_self;
+
+static int ws_take(WSDeque *d, int from_back, int *task){
+
+    int got = 0;
+    pthread_mutex_lock(&d->mu);
+    if (d->head < d->tail){
+        *task = from_back ? d->ids[--d->tail] : d->ids[d->head++];
+        got = 1;
+    }
+    pthread_mutex_unlock(&d->mu);
+    return got;
+}
+
+static void *ws_worker(void *arg){
+
+    WSWorker *w = (WSWorker*)arg;
+    WSPool *pool = w->pool;
+    int task;
+
+    pool_self = w->self;
+
+    for (;;){
+        if (ws_take(&pool->dq[w->self], 0, &task)){
+            pool->fn(pool->ctx, task);
+            continue;
+        }
+
+        //tasks never spawn tasks, so once every deque is empty the work is done
+        int stole = 0;
+        for (int k = 1; k < pool->nworkers && !stole; k++){
+            stole = ws_take(&pool->dq[(w->self + k) % pool->nworkers], 1, &task);
+        }
+        if (!stole){
+            break;
+        }
+        pool->fn(pool->ctx, task);
+    }
+    return NULL;
+}
+
+//run fn(ctx, 0..ntasks-1) on nworkers threads, tasks are dealt out round robin
+static void pool_run(int ntasks, int nworkers, void (*fn)(void*, int), void *ctx){
+
+    if (nworkers < 1){
+        nworkers = 1;
+    }
+
+    WSPool pool;
+    pool.nworkers = nworkers;
+    pool.fn = fn;
+    pool.ctx = ctx;
+    pool.dq = calloc((size_t)nworkers, sizeof(WSDeque));
+    WSWorker *ws = calloc((size_t)nworkers, sizeof(WSWorker));
+    pthread_t *th = calloc((size_t)nworkers, sizeof(pthread_t));
+
+    if (!pool.dq || !ws || !th){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (int k = 0; k < nworkers; k++){
+        pthread_mutex_init(&pool.dq[k].mu, NULL);
+        pool.dq[k].ids = malloc(sizeof(int) * (size_t)(ntasks / nworkers + 1));
+        if (!pool.dq[k].ids){
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    for (int t = 0; t < ntasks; t++){
+        WSDeque *d = &pool.dq[t % nworkers];
+        d->ids[d->tail++] = t;
+    }
+
+    for (int k = 0; k < nworkers; k++){
+        ws[k].pool = &pool;
+        ws[k].self = k;
+        if (pthread_create(&th[k], NULL, ws_worker, &ws[k]) != 0){
+            fprintf(stderr, "cannot start worker thread\n");
+            exit(1);
+        }
+    }
+    for (int k = 0; k < nworkers; k++){
+        pthread_join(th[k], NULL);
+    }
+
+    for (int k = 0; k < nworkers; k++){
+        pthread_mutex_destroy(&pool.dq[k].mu);
+        free(pool.dq[k].ids);
+    }
+    free(pool.dq);
+    free(ws);
+    free(th);
+}
+
+//trace.csv -> trace_<suffix> next to it
+static char *out_path(const char *trace, const char *suffix){
+
+    size_t len = strlen(trace);
+    const char *dot = strrchr(trace, '.');
+    const char *slash = strrchr(trace, '/');
+    if (dot && (!slash || dot > slash)){
+        len = (size_t)(dot - trace);
+    }
+
+    char *path = malloc(len + strlen(suffix) + 2);
+    if (!path){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    memcpy(path, trace, len);
+    path[len] = '_';
+    strcpy(path + len + 1, suffix);
+    return path;
+}
+
+
+//sweep points of one output pair can finish in any order, they are written in sweep order as soon as
+//every point before them is in
+typedef struct{
+    FILE *f_details;
+    FILE *f_summary;
+    int ncells;
+    char **det_buf;
+    size_t *det_len;
+    char **sum_buf;
+    size_t *sum_len;
+    char *ready;
+    int next_flush;
+    pthread_mutex_t mu;
+} OrderedOut;
+
+static void ord_init(OrderedOut *o, int ncells, FILE *f_details, FILE *f_summary){
+
+    size_t nc = (size_t)ncells;
+    o->f_details = f_details;
+    o->f_summary = f_summary;
+    o->ncells = ncells;
+    o->det_buf = calloc(nc, sizeof(char*));
+    o->det_len = calloc(nc, sizeof(size_t));
+    o->sum_buf = calloc(nc, sizeof(char*));
+    o->sum_len = calloc(nc, sizeof(size_t));
+    o->ready = calloc(nc, 1);
+    if (!o->det_buf || !o->det_len || !o->sum_buf || !o->sum_len || !o->ready){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    o->next_flush = 0;
+    pthread_mutex_init(&o->mu, NULL);
+}
+
+//hand over the bytes of sweep point c, they are freed once written
+static void ord_put(OrderedOut *o, int c, char *det, size_t dlen, char *sum, size_t slen){
+
+    pthread_mutex_lock(&o->mu);
+    o->det_buf[c] = det;
+    o->det_len[c] = dlen;
+    o->sum_buf[c] = sum;
+    o->sum_len[c] = slen;
+    o->ready[c] = 1;
+
+    while (o->next_flush < o->ncells && o->ready[o->next_flush]){
+        int k = o->next_flush++;
+        fwrite(o->det_buf[k], 1, o->det_len[k], o->f_details);
+        fwrite(o->sum_buf[k], 1, o->sum_len[k], o->f_summary);
+        free(o->det_buf[k]);
+        free(o->sum_buf[k]);
+        o->det_buf[k] = o->sum_buf[k] = NULL;
+    }
+    pthread_mutex_unlock(&o->mu);
+}
+
+static int ord_done(OrderedOut *o){
+    return o->next_flush == o->ncells;
+}
+
+static void ord_free(OrderedOut *o){
+
+    for (int c = 0; c < o->ncells; c++){
+        free(o->det_buf[c]);
+        free(o->sum_buf[c]);
+    }
+    free(o->det_buf);
+    free(o->det_len);
+    free(o->sum_buf);
+    free(o->sum_len);
+    free(o->ready);
+    pthread_mutex_destroy(&o->mu);
+}
+
+//a pair of in memory outputs for one sweep point
+static void mem_outputs(char **det, size_t *dlen, char **sum, size_t *slen, FILE **f_details, FILE **f_summary){
+
+    *det = *sum = NULL;
+    *dlen = *slen = 0;
+    *f_details = open_memstream(det, dlen);
+    *f_summary = open_memstream(sum, slen);
+    if (!*f_details || !*f_summary){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+}
+
+//batch mode (-b): every trace is loaded, sorted and gets its outputs opened on the pool, then each
+//(trace, sweep point) pair is one pool task. the simulator supplies the steps that depend on its policy
+typedef struct{
+    //"FCFS" or "RR", for the completion line
+    const char *name;
+    size_t size;
+    int (*cmp)(const void *a, const void *b);
+    //read a whole trace into a malloc'd array, returns 0 after reporting a bad trace
+    int (*load)(FILE *in, const char *path, void **jobs, size_t *n);
+    //optional per trace state of extra_size bytes, filled in from the sorted trace
+    size_t extra_size;
+    void (*prepare)(void *ctx, const char *path, const void *jobs, size_t n, void *extra);
+    //outputs are named trace_<suffix>, open writes their headers and returns 0 on failure
+    const char *details_suffix;
+    const char *summary_suffix;
+    int (*open)(void *ctx, const char *details, const char *summary, FILE **f_details, FILE **f_summary);
+    //run sweep point cell of one trace
+    void (*cell)(void *ctx, const void *jobs, size_t n, uint64_t hash, const void *extra, int cell,
+                 FILE *f_details, FILE *f_summary);
+    void *ctx;
+    int ncells;
+} BatchJob;
+
+//one trace of a batch run, its sweep points are written in order as soon as the ones before them are done
+typedef struct{
+    const char *path;
+    void *jobs;
+    size_t n;
+    uint64_t hash;
+    void *extra;
+    int ok;
+    OrderedOut out;
+} BatchTrace;
+
+typedef struct{
+    const BatchJob *job;
+    BatchTrace *traces;
+} Batch;
+
+static void batch_load(void *ctx, int task){
+
+    Batch *b = (Batch*)ctx;
+    const BatchJob *job = b->job;
+    BatchTrace *t = &b->traces[task];
+
+    FILE *in = fopen(t->path, "r");
+    if (!in){
+        fprintf(stderr, "cannot open %s\n", t->path);
+        return;
+    }
+    int loaded = job->load(in, t->path, &t->jobs, &t->n);
+    fclose(in);
+    if (!loaded){
+        return;
+    }
+
+    //a header only trace has nothing to sweep, skip it rather than write empty results
+    if (t->n == 0){
+        fprintf(stderr, "%s: no jobs, skipped\n", t->path);
+        return;
+    }
+
+    qsort(t->jobs, t->n, job->size, job->cmp);
+    t->hash = trace_hash(t->jobs, t->n, job->size);
+
+    if (job->extra_size){
+        t->extra = calloc(1, job->extra_size);
+        if (!t->extra){
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    if (job->prepare){
+        job->prepare(job->ctx, t->path, t->jobs, t->n, t->extra);
+    }
+
+    char *det = out_path(t->path, job->details_suffix);
+    char *sum = out_path(t->path, job->summary_suffix);
+    FILE *f_details, *f_summary;
+    if (!job->open(job->ctx, det, sum, &f_details, &f_summary)){
+        fprintf(stderr, "cannot open %s or %s for write\n", det, sum);
+        free(det);
+        free(sum);
+        return;
+    }
+    free(det);
+    free(sum);
+
+    ord_init(&t->out, job->ncells, f_details, f_summary);
+    t->ok = 1;
+}
+
+static void batch_cell(void *ctx, int task){
+
+    Batch *b = (Batch*)ctx;
+    const BatchJob *job = b->job;
+    BatchTrace *t = &b->traces[task / job->ncells];
+    int c = task % job->ncells;
+
+    if (!t->ok){
+        return;
+    }
+
+    char *det, *sum;
+    size_t dlen, slen;
+    FILE *fd, *fs;
+    mem_outputs(&det, &dlen, &sum, &slen, &fd, &fs);
+
+    job->cell(job->ctx, t->jobs, t->n, t->hash, t->extra, c, fd, fs);
+    fclose(fd);
+    fclose(fs);
+
+    ord_put(&t->out, c, det, dlen, sum, slen);
+}
+
+//simulate every trace over the whole sweep, loading and then simulating on one shared pool
+static int batch_run(const BatchJob *job, char **paths, int ntraces, int nworkers){
+
+    Batch b;
+    b.job = job;
+    b.traces = calloc((size_t)ntraces, sizeof(BatchTrace));
+    if (!b.traces){
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (int k = 0; k < ntraces; k++){
+        b.traces[k].path = paths[k];
+    }
+
+    pool_run(ntraces, nworkers, batch_load, &b);
+    pool_run(ntraces * job->ncells, nworkers, batch_cell, &b);
+
+    int failed = 0;
+    for (int k = 0; k < ntraces; k++){
+        BatchTrace *t = &b.traces[k];
+        failed += !t->ok;
+        if (t->ok){
+            fclose(t->out.f_details);
+            fclose(t->out.f_summary);
+            ord_free(&t->out);
+        }
+        free(t->jobs);
+        free(t->extra);
+    }
+    free(b.traces);
+
+    printf("%s batch completed! %d of %d traces simulated, results saved next to each trace\n", job->name,
+        ntraces - failed, ntraces);
+    return failed ? 1 : 0;
+}
+
+//ensemble helpers: every variant draws from its own splitmix64 stream, the summary keeps the mean of
+//each metric and a 95% percentile band across the variants
+#define ENS_METRICS 4
+
+static uint64_t splitmix64(uint64_t *s){
+
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+//uniform in [0, 1)
+static double rng_unit(uint64_t *s){
+    return (double)(splitmix64(s) >> 11) * 0x1p-53;
+}
+
+//stream for variant v, seeded from v alone so a variant comes out the same whichever worker builds it
+static uint64_t variant_seed(uint64_t seed, int v){
+    return seed ^ ((uint64_t)v * 0xd1b54a32d192ed03ULL);
+}
+
+//round v * f to the nearest int, clamped to the int range
+static int scale_int(int v, double f){
+
+    double x = (double)v * f;
+    x = x < 0.0 ? x - 0.5 : x + 0.5;
+    if (x >= (double)INT_MAX){
+        return INT_MAX;
+    }
+    if (x <= (double)INT_MIN){
+        return INT_MIN;
+    }
+    return (int)x;
+}
+
+//move the arrival by up to +-jitter and scale the burst and first response offset by a factor within 1 +- scale
+static void perturb_job(uint64_t *s, int jitter, double scale, int *arrival, int *first_resp, int *burst){
+
+    if (jitter > 0){
+        uint64_t span = 2 * (uint64_t)jitter + 1;
+        int64_t a = (int64_t)*arrival + (int64_t)(splitmix64(s) % span) - jitter;
+        *arrival = a < 0 ? 0 : a > INT_MAX ? INT_MAX : (int)a;
+    }
+
+    if (scale > 0.0){
+        double f = 1.0 + scale * (2.0 * rng_unit(s) - 1.0);
+        int b = scale_int(*burst, f);
+        //a job that had work keeps at least one tick of it
+        if (b < 1 && *burst > 0){
+            b = 1;
+        }
+        *first_resp = scale_int(*first_resp, f);
+        *burst = b;
+    }
+}
+
+static int cmp_double(const void *a, const void *b){
+
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+//linear interpolation between the closest ranks of a sorted sample
+static double percentile(const double *v, int k, double pct){
+
+    double pos = pct * (double)(k - 1);
+    int lo = (int)pos;
+    if (lo >= k - 1){
+        return v[k - 1];
+    }
+    return v[lo] + (pos - (double)lo) * (v[lo + 1] - v[lo]);
+}
+
+//write the banded summary, metrics[(variant * ncells + cell) * ENS_METRICS + m] for k variants.
+//names are the plain summary columns, the sweep parameter first
+static void ens_write(FILE *f, const char *const *names, int lo, int ncells, int k, const double *metrics){
+
+    double *sample = malloc(sizeof(double) * (size_t)k);
+    if (!sample){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    fprintf(f, "%s", names[0]);
+    for (int m = 1; m <= ENS_METRICS; m++){
+        fprintf(f, ",%s,%s_Lo,%s_Hi", names[m], names[m], names[m]);
+    }
+    fprintf(f, "\n");
+
+    for (int c = 0; c < ncells; c++){
+        fprintf(f, "%d", lo + c);
+        for (int m = 0; m < ENS_METRICS; m++){
+            double sum = 0.0;
+            for (int v = 0; v < k; v++){
+                sample[v] = metrics[((size_t)v * ncells + c) * ENS_METRICS + m];
+                sum += sample[v];
+            }
+            qsort(sample, (size_t)k, sizeof(double), cmp_double);
+
+            //throughput is a small fraction, the time averages keep two decimals like the plain summary
+            const char *fmt = m == 0 ? ",%.6f,%.6f,%.6f" : ",%.2f,%.2f,%.2f";
+            fprintf(f, fmt, sum / k, percentile(sample, k, 0.025), percentile(sample, k, 0.975));
+        }
+        fprintf(f, "\n");
+    }
+    free(sample);
+}
+
+static double elapsed_since(const struct timespec *t0){
+
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (double)(t1.tv_sec - t0->tv_sec) + (double)(t1.tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+//ensemble mode (-e K): K perturbed variants of the trace are simulated over the whole sweep. every variant
+//resamples the jobs with replacement and can also jitter arrivals and scale bursts. the summary then holds,
+//per sweep point, the mean of each metric across the variants and a 95% percentile band around it
+typedef struct{
+    //"FCFS" or "RR", for the completion line
+    const char *name;
+    //the sorted trace the variants are drawn from
+    const void *base;
+    size_t n;
+    size_t size;
+    int (*cmp)(const void *a, const void *b);
+    int k;
+    //arrivals move by up to +-jitter, bursts are scaled by a factor within 1 +- scale
+    int jitter;
+    double scale;
+    uint64_t seed;
+    int lo;
+    int ncells;
+    //plain summary columns, the sweep parameter first
+    const char *const *names;
+    //simulate every sweep point of one sorted variant, metrics[cell * ENS_METRICS + m]. each pool worker
+    //has worker_size zeroed bytes of its own that run may keep state in, released by worker_free
+    size_t worker_size;
+    void (*run)(void *ctx, void *worker, const void *jobs, size_t n, double *metrics);
+    void (*worker_free)(void *worker);
+    void *ctx;
+} EnsJob;
+
+typedef struct{
+    const EnsJob *job;
+    //one scratch trace and one state block per pool worker, reused from variant to variant
+    char **scratch;
+    char *worker;
+    //metrics[(variant * ncells + cell) * ENS_METRICS + m]
+    double *metrics;
+} Ensemble;
+
+//fill dst with variant v
+static void make_variant(const EnsJob *e, int v, char *dst){
+
+    uint64_t s = variant_seed(e->seed, v);
+
+    for (size_t i = 0; i < e->n; i++){
+        char *job = dst + i * e->size;
+        memcpy(job, (const char*)e->base + (splitmix64(&s) % e->n) * e->size, e->size);
+
+        JobHead h;
+        memcpy(&h, job, sizeof(h));
+        perturb_job(&s, e->jitter, e->scale, &h.arrival, &h.first_resp, &h.burst);
+        //resampled copies of one job tie on arrival and pid, position breaks the tie
+        h.index = (int)i;
+        memcpy(job, &h, sizeof(h));
+    }
+}
+
+static void ensemble_variant(void *ctx, int task){
+
+    Ensemble *en = (Ensemble*)ctx;
+    const EnsJob *e = en->job;
+    char *jobs = en->scratch[pool_self];
+
+    make_variant(e, task, jobs);
+    qsort(jobs, e->n, e->size, e->cmp);
+
+    e->run(e->ctx, en->worker + (size_t)pool_self * e->worker_size, jobs, e->n,
+           &en->metrics[(size_t)task * e->ncells * ENS_METRICS]);
+}
+
+static int ens_run(const EnsJob *e, int nworkers, const char *path){
+
+    if (e->n == 0){
+        fprintf(stderr, "ensemble needs a trace with at least one job\n");
+        return 1;
+    }
+    if (nworkers < 1){
+        nworkers = 1;
+    }
+
+    Ensemble en;
+    en.job = e;
+    en.scratch = calloc((size_t)nworkers, sizeof(char*));
+    en.worker = calloc((size_t)nworkers, e->worker_size ? e->worker_size : 1);
+    en.metrics = malloc(sizeof(double) * (size_t)e->k * (size_t)e->ncells * ENS_METRICS);
+    if (!en.scratch || !en.worker || !en.metrics){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (int w = 0; w < nworkers; w++){
+        en.scratch[w] = malloc(e->size * e->n);
+        if (!en.scratch[w]){
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    FILE *f = fopen(path, "w");
+    if (!f){
+        fprintf(stderr, "cannot open %s for write\n", path);
+        return 1;
+    }
+
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pool_run(e->k, nworkers, ensemble_variant, &en);
+    double secs = elapsed_since(&t0);
+
+    ens_write(f, e->names, e->lo, e->ncells, e->k, en.metrics);
+    fclose(f);
+
+    printf("%s ensemble completed! %d variants x %d sweep points in %.2fs (%.0f simulations/s)\n", e->name, e->k,
+        e->ncells, secs, secs > 0.0 ? (double)e->k * e->ncells / secs : 0.0);
+    printf("Mean and 95%% bands saved to %s\n", path);
+
+    for (int w = 0; w < nworkers; w++){
+        if (e->worker_free){
+            e->worker_free(en.worker + (size_t)w * e->worker_size);
+        }
+        free(en.scratch[w]);
+    }
+    free(en.scratch);
+    free(en.worker);
+    free(en.metrics);
+    return 0;
+}
+
+//sharded sweep (-w N): the coordinator puts the sorted trace in a POSIX shared memory segment and
+//forks N workers that map it read only. each worker gets one sweep point at a time over its end of a
+//unix socket pair and sends back the detail and summary bytes, which the coordinator writes out in
+//sweep order. a worker that dies has its sweep point handed to a fresh worker
+
+//run sweep point cell inside a worker. seg is the mapped segment, ctx is the worker's own copy of the
+//coordinator's context since fork duplicated it, so a worker may keep state there between points
+typedef void (*ShardFn)(void *ctx, const void *seg, int cell, FILE *f_details, FILE *f_summary);
+
+typedef struct{
+    //names the segment, /<tag>-<pid>
+    const char *tag;
+    //segment contents: a fixed size header, then the rows
+    const void *head;
+    size_t head_len;
+    const void *rows;
+    size_t rows_len;
+    int ncells;
+    ShardFn fn;
+    void *ctx;
+    //sweep parameter name and first value, for messages
+    const char *param;
+    int lo;
+} ShardJob;
+
+typedef struct{
+    int32_t cell;
+    uint32_t pad;
+    uint64_t det_len;
+    uint64_t sum_len;
+} ShardReply;
+
+typedef struct{
+    pid_t pid;
+    int fd;
+    //sweep point in flight, -1 when idle
+    int cell;
+} ShardWorker;
+
+//give up on a sweep point that keeps killing its worker
+#define SHARD_MAX_TRIES 3
+
+static int read_full(int fd, void *buf, size_t len){
+
+    char *b = (char*)buf;
+    while (len > 0){
+        ssize_t r = read(fd, b, len);
+        if (r < 0 && errno == EINTR){
+            continue;
+        }
+        if (r <= 0){
+            return 0;
+        }
+        b += r;
+        len -= (size_t)r;
+    }
+    return 1;
+}
+
+static int write_full(int fd, const void *buf, size_t len){
+
+    const char *b = (const char*)buf;
+    while (len > 0){
+        ssize_t w = write(fd, b, len);
+        if (w < 0 && errno == EINTR){
+            continue;
+        }
+        if (w <= 0){
+            return 0;
+        }
+        b += w;
+        len -= (size_t)w;
+    }
+    return 1;
+}
+
+//worker side: map the trace and answer requests until told to stop or the coordinator goes away
+static void shard_worker(int fd, const char *shm_name, const ShardJob *job){
+
+    int sfd = shm_open(shm_name, O_RDONLY, 0);
+    struct stat sb;
+    if (sfd < 0 || fstat(sfd, &sb) != 0){
+        _exit(1);
+    }
+    void *map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, sfd, 0);
+    close(sfd);
+    if (map == MAP_FAILED){
+        _exit(1);
+    }
+
+    int32_t cell;
+    while (read_full(fd, &cell, sizeof(cell)) && cell >= 0){
+        char *det, *sum;
+        size_t dlen, slen;
+        FILE *fd_det, *fd_sum;
+        mem_outputs(&det, &dlen, &sum, &slen, &fd_det, &fd_sum);
+
+        job->fn(job->ctx, map, cell, fd_det, fd_sum);
+        fclose(fd_det);
+        fclose(fd_sum);
+
+        ShardReply rep = { cell, 0, dlen, slen };
+        if (!write_full(fd, &rep, sizeof(rep)) || !write_full(fd, det, dlen) || !write_full(fd, sum, slen)){
+            _exit(1);
+        }
+        free(det);
+        free(sum);
+    }
+    _exit(0);
+}
+
+static int shard_spawn(ShardWorker *w, const char *shm_name, const ShardJob *job){
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0){
+        return 0;
+    }
+
+    //buffered output would otherwise be flushed twice, once by each process
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0){
+        close(sv[0]);
+        close(sv[1]);
+        return 0;
+    }
+    if (pid == 0){
+        close(sv[0]);
+        shard_worker(sv[1], shm_name, job);
+    }
+
+    close(sv[1]);
+    w->pid = pid;
+    w->fd = sv[0];
+    w->cell = -1;
+    return 1;
+}
+
+//hand the next sweep point to an idle worker, requeued points go first
+static void shard_assign(ShardWorker *w, int *requeue, int *nrequeue, int *next_cell, int ncells){
+
+    int cell;
+    if (*nrequeue > 0){
+        cell = requeue[--*nrequeue];
+    }
+    else if (*next_cell < ncells){
+        cell = (*next_cell)++;
+    }
+    else{
+        return;
+    }
+
+    int32_t msg = cell;
+    w->cell = cell;
+    //a failed send shows up as a dead worker on the next poll
+    write_full(w->fd, &msg, sizeof(msg));
+}
+
+//run every sweep point of job on nprocs worker processes, writing the results in sweep order
+static int shard_run(const ShardJob *job, int nprocs, FILE *f_details, FILE *f_summary){
+
+    //one copy of the trace for every worker
+    char shm_name[64];
+    snprintf(shm_name, sizeof(shm_name), "/%s-%ld", job->tag, (long)getpid());
+    size_t bytes = job->head_len + job->rows_len;
+
+    int sfd = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (sfd < 0 || ftruncate(sfd, (off_t)bytes) != 0){
+        fprintf(stderr, "cannot create shared memory %s\n", shm_name);
+        if (sfd >= 0){
+            close(sfd);
+            shm_unlink(shm_name);
+        }
+        return 1;
+    }
+    void *map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, sfd, 0);
+    close(sfd);
+    if (map == MAP_FAILED){
+        fprintf(stderr, "cannot map shared memory %s\n", shm_name);
+        shm_unlink(shm_name);
+        return 1;
+    }
+    memcpy(map, job->head, job->head_len);
+    memcpy((char*)map + job->head_len, job->rows, job->rows_len);
+
+    //a dead worker must show up as a failed read or write, not kill the coordinator
+    signal(SIGPIPE, SIG_IGN);
+
+    int ncells = job->ncells;
+    if (nprocs > ncells){
+        nprocs = ncells;
+    }
+
+    OrderedOut out;
+    ord_init(&out, ncells, f_details, f_summary);
+    int *tries = calloc((size_t)ncells, sizeof(int));
+    int *requeue = calloc((size_t)ncells, sizeof(int));
+    ShardWorker *ws = calloc((size_t)nprocs, sizeof(ShardWorker));
+    struct pollfd *pfd = calloc((size_t)nprocs, sizeof(struct pollfd));
+    if (!tries || !requeue || !ws || !pfd){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    int rc = 0;
+    int nrequeue = 0, next_cell = 0, restarts = 0;
+
+    for (int k = 0; k < nprocs; k++){
+        if (!shard_spawn(&ws[k], shm_name, job)){
+            fprintf(stderr, "cannot start worker process\n");
+            exit(1);
+        }
+        shard_assign(&ws[k], requeue, &nrequeue, &next_cell, ncells);
+    }
+
+    while (!ord_done(&out) && rc == 0){
+        for (int k = 0; k < nprocs; k++){
+            pfd[k].fd = ws[k].fd;
+            pfd[k].events = POLLIN;
+            pfd[k].revents = 0;
+        }
+        if (poll(pfd, (nfds_t)nprocs, -1) < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            fprintf(stderr, "poll failed\n");
+            rc = 1;
+            break;
+        }
+
+        for (int k = 0; k < nprocs && rc == 0; k++){
+            if (!pfd[k].revents){
+                continue;
+            }
+            ShardWorker *w = &ws[k];
+
+            ShardReply rep;
+            char *det = NULL, *sum = NULL;
+            int ok = read_full(w->fd, &rep, sizeof(rep)) && rep.cell == w->cell;
+            if (ok){
+                det = malloc(rep.det_len ? rep.det_len : 1);
+                sum = malloc(rep.sum_len ? rep.sum_len : 1);
+                if (!det || !sum){
+                    fprintf(stderr, "out of memory\n");
+                    exit(1);
+                }
+                ok = read_full(w->fd, det, rep.det_len) && read_full(w->fd, sum, rep.sum_len);
+            }
+
+            if (!ok){
+                //worker died: reap it, put its sweep point back and start a replacement
+                free(det);
+                free(sum);
+                close(w->fd);
+                waitpid(w->pid, NULL, 0);
+
+                if (w->cell >= 0){
+                    if (++tries[w->cell] >= SHARD_MAX_TRIES){
+                        fprintf(stderr, "%s %d crashed %d workers, giving up\n", job->param, job->lo + w->cell,
+                            SHARD_MAX_TRIES);
+                        rc = 1;
+                        break;
+                    }
+                    requeue[nrequeue++] = w->cell;
+                }
+                restarts++;
+                if (!shard_spawn(w, shm_name, job)){
+                    fprintf(stderr, "cannot restart worker process\n");
+                    rc = 1;
+                    break;
+                }
+                shard_assign(w, requeue, &nrequeue, &next_cell, ncells);
+                continue;
+            }
+
+            w->cell = -1;
+            shard_assign(w, requeue, &nrequeue, &next_cell, ncells);
+            ord_put(&out, rep.cell, det, rep.det_len, sum, rep.sum_len);
+        }
+    }
+
+    //tell the workers to stop, then reap them
+    for (int k = 0; k < nprocs; k++){
+        int32_t stop = -1;
+        write_full(ws[k].fd, &stop, sizeof(stop));
+        close(ws[k].fd);
+    }
+    for (int k = 0; k < nprocs; k++){
+        waitpid(ws[k].pid, NULL, 0);
+    }
+
+    if (restarts > 0){
+        fprintf(stderr, "restarted %d worker process%s\n", restarts, restarts == 1 ? "" : "es");
+    }
+
+    ord_free(&out);
+    free(tries);
+    free(requeue);
+    free(ws);
+    free(pfd);
+    munmap(map, bytes);
+    shm_unlink(shm_name);
+    return rc;
+}
+
+#endif